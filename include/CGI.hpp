@@ -7,6 +7,23 @@
 
 class CGI
 {
+    public:
+        // What writing the request body to the script achieved
+        enum InputState {
+            INPUT_DONE,     // all of it went out and the stream is closed
+            INPUT_BLOCKED,  // the pipe or socket is full
+            INPUT_STARVED,  // everything received so far went out, more is coming
+            INPUT_FAILED    // the connection to the application broke
+        };
+
+        // How far the script's output is: its header block is split off as
+        // soon as it is complete, so the response can start before the body
+        enum HeaderState {
+            HEADERS_PENDING,
+            HEADERS_READY,
+            HEADERS_INVALID
+        };
+
     private:
         std::string						script_path;
         std::string						script_name;
@@ -36,19 +53,42 @@ class CGI
         std::string						remote_user;
         std::string						remote_ident;
         std::map<std::string, std::string>	env_vars;
-        std::string						request_body;
+        const Request*					request; // still receiving its body while the script runs
         std::string						cgi_headers;
-        std::string						cgi_body;
-        static const int				CGI_TIMEOUT = 30; // 30 seconds timeout
+        pid_t							pid;
+        int								pidfd;     // set for children of the zygote, which the server cannot reap
+        bool							spawning;  // asked of the zygote, its answer not in yet
+        int								stdin_fd;  // write end of the child's stdin pipe
+        int								stdout_fd; // read end of the child's stdout pipe
+        int								stderr_fd; // read end of the child's stderr pipe
+        size_t							input_offset; // bytes of the request body already written
+        std::string						output; // read and not taken yet: the header block, then body bytes
+        HeaderState						header_state;
+        size_t							body_left; // bytes the script's Content-Length still allows, npos without one
+        std::string						backend_address; // fastcgi_pass target, empty when a child runs the script
+        int								backend_fd; // connection to the FastCGI application
+        std::string						backend_out; // encoded records not written yet
+        size_t							backend_out_offset;
+        std::string						backend_in; // bytes of a record that is not complete yet
+        bool							backend_stdin_done; // the closing FCGI_STDIN record is queued
+        bool							backend_ended; // FCGI_END_REQUEST received for a completed request
+        unsigned long					run_deadline; // ms, TimerWheel clock: the script is stopped then, output or not
 
         void							setupEnvironment();
         char**							createEnvArray();
         void							freeEnvArray(char** env);
-        std::string						executeScript();
+        bool							spawnScript();
+        bool							requestFromZygote(int zygote_fd);
+        void							adoptPipes(int in, int out, int err);
         bool							isValidScript(const std::string& path);
-        bool							parseCGIOutput(const std::string& output);
+        bool							parseHeaderBlock(size_t header_end, size_t separator_length);
+        void							splitHeaders(bool at_end);
         void							setupStandardEnvironment();
-        bool							waitForChildWithTimeout(pid_t pid, int timeout);
+        bool							queueBackendInput();
+        bool							parseBackendRecords();
+        static void						closeFd(int& fd);
+        static void						appendRecord(std::string& out, unsigned char type, const char* data, size_t length);
+        static void						appendParam(std::string& out, const std::string& name, const std::string& value);
 
     public:
         CGI();
@@ -58,10 +98,46 @@ class CGI
         void							setDocumentRoot(const std::string& root);
         void							setServerInfo(const std::string& name, const std::string& port);
         void							setInterpreter(const std::string& interpreter);
-        std::string						execute();
+        static const int				CGI_TIMEOUT = 30; // 30 seconds without output or input
+        static const int				CGI_RUN_TIMEOUT = 300; // longest a script may run, however steadily it writes
+        void							setRunDeadline(unsigned long deadline);
+        unsigned long					getRunDeadline() const;
+        // Asynchronous execution, driven by the epoll loop
+        bool							start(int zygote_fd);
+        bool							adoptSpawned(pid_t child, const int fds[4]);
+        bool							isSpawning() const;
+        InputState						writeInput();
+        ssize_t							readOutput();
+        ssize_t							readErrors();
+        void							closeStdin();
+        void							closeStdout();
+        void							closeStderr();
+        bool							reap();
+        void							terminate();
+        bool							finish();
+        // FastCGI: the request goes to an application over a pooled connection
+        void							startFastCGI(const std::string& address, int fd);
+        InputState						writeBackend();
+        ssize_t							readBackend();
+        bool							isWritingBackend() const;
+        bool							hasBackendEnded() const;
+        bool							isBackendReusable() const;
+        int								detachBackend();
+        void							closeBackend();
+        int								getBackendFd() const;
+        const std::string&				getBackendAddress() const;
+        bool							isRunning() const;
+        pid_t							getPid() const;
+        int								getStdinFd() const;
+        int								getStdoutFd() const;
+        int								getStderrFd() const;
+        HeaderState						getHeaderState() const;
         std::string						getHeaders() const;
-        std::string						getBody() const;
+        const std::string&				getOutput() const;
+        void							takeOutput(std::string& body);
+        bool							isBodyShort() const;
         // Static methods
+        static pid_t					spawnProcess(const char* interpreter, const char* script, char** env, const int child_fds[3]);
         static std::string				getScriptExtension(const std::string& filename);
         static bool						isCGIScript(const std::string& filename, const std::map<std::string, std::string>& cgi_extensions);
 };
@@ -0,0 +1,39 @@
+#ifndef CGIZYGOTE_HPP
+#define CGIZYGOTE_HPP
+
+#include "webserv.hpp"
+
+// Helper process that starts CGI scripts for the server. It is forked at
+// startup, before any listener or client exists, so scripts are started from
+// a small process with no sockets in it, however large the server has grown.
+// Each worker owns one channel to it (a SOCK_SEQPACKET socketpair), watched
+// by its epoll loop, and sends one spawn request per message; replies come
+// back in the order of the requests. A reply carries the child's pid and, as
+// SCM_RIGHTS, the server ends of its stdin, stdout and stderr pipes and a
+// pidfd for the child. The helper reaps its children, so their pids can be
+// reused as soon as they exit: the server signals a child through its pidfd
+// only, never by pid.
+class CGIZygote {
+private:
+	pid_t				pid;
+	std::vector<int>	channels;	// server ends, one per worker
+
+	static void	serve(std::vector<int>& channels);
+	static void	spawnChild(int channel, char* message, size_t length);
+	static void	reply(int channel, pid_t child, const int* fds, int count);
+	static int	openPidfd(pid_t child);
+
+	CGIZygote(const CGIZygote& other);
+	CGIZygote& operator=(const CGIZygote& other);
+public:
+	CGIZygote();
+	~CGIZygote();
+	bool		start(size_t channel_count);
+	void		stop();
+	int			getChannel(size_t index) const;
+	static bool	request(int channel, const std::string& message);
+	static int	receive(int channel, pid_t& child, int fds[4]);
+	static bool	kill(int pidfd, int signal);
+};
+
+#endif
@@ -1,46 +1,79 @@
 #pragma once
 
-#include "Server.hpp"
+#include "VirtualHosts.hpp"
 #include "Request.hpp"
 #include "Response.hpp"
-#include <ctime>
+#include "CGI.hpp"
+#include "MultipartParser.hpp"
+#include "TimerWheel.hpp"
+#include "EventSource.hpp"
 
 class Client
 {
 private:
 	static int			client_count;
-	const int			id;
-	const int			socket_fd;
-	const Server&		server;
+	int					id;
+	int					socket_fd;		// -1 while the slot is free
+	const VirtualHosts*	hosts;			// servers sharing the listener the client came in on
+	const Server*		server;			// the default one until the Host header picks another
+	bool				host_selected;
 	Request				request;
 	Response			response;
-	std::string			buffer;
+	CGI					cgi;
+	MultipartParser		upload;			// streams multipart/form-data bodies to disk
 	bool				request_ready;
+	bool				response_started;	// header block queued; a streamed body may still be coming
 	bool				response_sent;
-	time_t				last_activity;
-	int					send_retry_count;
+	TimerNode			timer;			// deadline of whatever the client is waiting on
+	int					requests_served;
+	std::string			out_buffer;		// serialized header block and streamed body bytes waiting for the socket
+	size_t				out_offset;		// bytes of out_buffer already written
+	bool				keep_alive;		// connection persists once the response is out
+	uint32_t			epoll_events;	// events currently registered for socket_fd
+	EventSource			socket_source;
+	EventSource			pipe_sources[3];	// the CGI's stdin, stdout (or FastCGI connection) and stderr
+
+	Client(const Client& other);
+	Client& operator=(const Client& other);
 
 public:
-	Client(int fd, Server& server);
+	Client();
 	~Client();
 
+	void				open(int fd, const VirtualHosts& hosts);
+	void				release();
+	bool				isOpen() const;
+
 	int					getFd() const;
 	const Server&		getServer() const;
 	Request&			getRequest();
 	Response&			getResponse();
+	CGI&				getCGI();
+	MultipartParser&	getUpload();
 	bool				isRequestReady() const;
+	bool				isResponseStarted() const;
 	bool				isResponseSent() const;
 	void				setRequestReady(bool ready);
+	void				setResponseStarted(bool started);
 	void				setResponseSent(bool sent);
-	void				appendData(const std::string& data);
+	void				appendData(const char* data, size_t length);
+	void				beginBody();
 	void				reset();
+	bool				shouldKeepAlive() const;
+	bool				isKeepAliveIdle() const;
 	std::string			toString() const;
-	void				updateLastActivity();
-	time_t				getLastActivity() const;
-	bool				isTimedOut(int timeout_seconds) const;
-	void				incrementSendRetries();
-	int					getSendRetries() const;
-	void				resetSendRetries();
+	TimerNode&			getTimer();
+	EventSource&		getSocketSource();
+	EventSource*		getPipeSources();
+	std::string&		getOutputBuffer();
+	bool				hasPendingOutput() const;
+	const char*			getPendingOutput() const;
+	size_t				getPendingSize() const;
+	void				consumeOutput(size_t bytes);
+	bool				isKeepAlive() const;
+	void				setKeepAlive(bool keep);
+	uint32_t			getEpollEvents() const;
+	void				setEpollEvents(uint32_t events);
 };
 
 std::ostream& operator<<(std::ostream& os, const Client& client);
\ No newline at end of file
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "Client.hpp"
+#include <vector>
+
+// Preallocated slab of connections for one event loop. Slots are handed out
+// from a free list and recycled; a released slot only becomes reusable at
+// recycle(), so events still queued in the current batch never see it reused.
+class ClientPool
+{
+private:
+	Client*					slots;
+	size_t					capacity;
+	size_t					in_use;
+	std::vector<Client*>	free_slots;
+	std::vector<Client*>	released;	// closed during this loop iteration
+
+	ClientPool(const ClientPool& other);
+	ClientPool& operator=(const ClientPool& other);
+
+public:
+	explicit ClientPool(size_t capacity);
+	~ClientPool();
+
+	Client*					acquire(int fd, const VirtualHosts& hosts);	// NULL when the pool is full
+	void					release(Client& client);
+	void					recycle();
+	size_t					size() const;
+	size_t					getCapacity() const;
+	Client&					at(size_t slot);
+	static size_t			defaultCapacity();
+};
@@ -10,12 +10,20 @@ class Config
 			int			code;
 			std::string	text;
 		};
+		enum {
+			METHOD_BIT_GET = 1 << 0,
+			METHOD_BIT_POST = 1 << 1,
+			METHOD_BIT_DELETE = 1 << 2
+		};
 	protected:
 		enum {
 			CLIENT_MAX_BODY_SIZE_INDEX = 0,
 			ROOT_INDEX,
 			AUTOINDEX_INDEX,
 			METHODS_INDEX,
+			SENDFILE_INDEX,
+			CLIENT_BODY_BUFFER_SIZE_INDEX,
+			CLIENT_BODY_TEMP_PATH_INDEX,
 			TOTAL_INDEX
 		};
 		bool	_inicializated[TOTAL_INDEX]; // Track which config fields have been explicitly set
@@ -26,34 +34,45 @@ class Config
 		bool	_autoindex; // Enable directory listing when no index file found
 		ReturnData	_return_data; // HTTP redirect configuration
 		std::vector<std::string> _methods; // Allowed HTTP methods
+		unsigned int	_method_mask; // _methods as METHOD_BIT_* flags, checked on every request
 		std::map<std::string, std::string> _cgi_extensions; // File extension -> CGI interpreter path
 		std::string _auth_basic_realm; // Basic auth realm name
 		std::string _auth_basic_user_file; // Path to htpasswd-style user file
+		bool	_sendfile; // Serve static files with sendfile() instead of reading them into memory
+		size_t	_client_body_buffer_size; // Request bodies up to this size stay in memory
+		std::string	_client_body_temp_path; // Directory where larger request bodies are spooled
 		Config();
 		virtual ~Config();
 	public:
-		std::map<int, std::string>		get_error_pages() const;
+		std::map<int, std::string> const&	get_error_pages() const;
 		std::string						get_error_page( int code ) const;
 		void							add_error_page( int code, std::string path );
 		size_t							get_client_max_size() const;
 		void							set_client_max_size( size_t client_max_size );
-		std::string						get_root() const;
+		std::string const&				get_root() const;
 		void							set_root( std::string root );
-		std::vector<std::string>		get_indexes() const ;
+		std::vector<std::string> const&	get_indexes() const;
 		void							add_index( std::string index );
 		bool							get_autoindex() const;
 		void							set_autoindex( bool autoindex );
 		ReturnData const&				get_return() const;
 		void							set_return( ReturnData data );
-		std::vector<std::string>		get_methods() const;
-		bool							has_method( std::string const method ) const;
+		std::vector<std::string> const&	get_methods() const;
+		bool							has_method( std::string const& method ) const;
 		void							add_method( std::string method );
-		std::map<std::string, std::string>	get_cgi_extensions() const;
+		static unsigned int				method_bit( std::string const& method );
+		std::map<std::string, std::string> const&	get_cgi_extensions() const;
 		void							add_cgi_extension( std::string extension, std::string interpreter );
-		std::string						get_auth_basic_realm() const;
+		std::string const&				get_auth_basic_realm() const;
 		void							set_auth_basic_realm( std::string realm );
-		std::string						get_auth_basic_user_file() const;
+		std::string const&				get_auth_basic_user_file() const;
 		void							set_auth_basic_user_file( std::string user_file );
+		bool							get_sendfile() const;
+		void							set_sendfile( bool sendfile );
+		size_t							get_client_body_buffer_size() const;
+		void							set_client_body_buffer_size( size_t size );
+		std::string const&				get_client_body_temp_path() const;
+		void							set_client_body_temp_path( std::string path );
 		std::string						printCfg() const;
 		std::string						printCfg( std::string preline ) const;
 		void							inherit( Config const& src );
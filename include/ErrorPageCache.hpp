@@ -0,0 +1,63 @@
+#ifndef ERRORPAGECACHE_HPP
+#define ERRORPAGECACHE_HPP
+
+#include "webserv.hpp"
+#include "Config.hpp"
+#include "Server.hpp"
+#include "StaticCache.hpp"
+#include <pthread.h>
+
+#define ERROR_PAGE_RECHECK_MS 1000 // how often a page's source files are stat()ed
+
+// Error pages rendered once into ready-to-send bodies with their Content-Type
+// and Content-Length lines. A page comes from the scope's error_page override,
+// else from the 4xx/5xx/6xx.html template under its root with the
+// placeholders filled in, else from the built-in page. Scopes (a server or
+// one of its locations) resolving to the same files share one page. Every
+// page is compiled with the configuration and the cache is shared by all
+// workers: a page whose files changed, appeared or went away is rebuilt by
+// the first worker to notice, at most once per ERROR_PAGE_RECHECK_MS, and
+// swapped in under a lock held only to take or replace the pointer.
+class ErrorPageCache {
+private:
+	// A file a page was built from, or would be built from once it exists
+	struct Source {
+		std::string	path;
+		bool		is_template;	// placeholders get filled in
+		bool		exists;
+		ino_t		ino;
+		off_t		size;
+		time_t		mtime;
+	};
+	struct Page {
+		StaticCache::Entry*		entry;		// current version, guarded by lock
+		std::vector<Source>		sources;	// guarded by recheck_lock
+		int						code;
+		volatile unsigned long	checked;	// ms, TimerWheel clock; claimed atomically
+	};
+	typedef std::map<std::string, Page>		PageMap;	// override, template and code -> page
+	typedef std::map<int, Page*>			CodeMap;
+	typedef std::map<const Config*, CodeMap>	ScopeMap;
+
+	PageMap			pages;
+	ScopeMap		scopes;
+	pthread_mutex_t	lock;			// taken to read or swap a page's entry
+	pthread_mutex_t	recheck_lock;	// held by the one worker stat()ing sources
+
+	void						add(const Config& scope, int code);
+	void						recheck(Page& page);
+	static void					watch(Page& page, const std::string& path, bool is_template);
+	static bool					isCurrent(const Source& source);
+	static StaticCache::Entry*	build(Page& page);
+
+	ErrorPageCache(const ErrorPageCache& other);
+	ErrorPageCache& operator=(const ErrorPageCache& other);
+public:
+	ErrorPageCache();
+	~ErrorPageCache();
+	void					compile(const Server& server);
+	StaticCache::Entry*		acquire(const Config& scope, int code);
+	size_t					getCount() const;
+};
+
+#endif
@@ -0,0 +1,18 @@
+#pragma once
+
+class VirtualHosts;
+class Client;
+
+// What an epoll registration refers to: epoll_event.data.ptr points at one of
+// these, so dispatching an event needs no lookup
+struct EventSource
+{
+	enum Kind { LISTENER, CLIENT, CGI_PIPE, ZYGOTE };
+
+	Kind				kind;
+	int					fd;		// -1 once the fd is no longer watched
+	const VirtualHosts*	hosts;	// LISTENER: the servers accepting on fd
+	Client*				client;	// CLIENT, CGI_PIPE: the connection fd belongs to
+
+	EventSource() : kind(CLIENT), fd(-1), hosts(NULL), client(NULL) {}
+};
@@ -0,0 +1,28 @@
+#ifndef FASTCGIPOOL_HPP
+#define FASTCGIPOOL_HPP
+
+#include "webserv.hpp"
+
+// Idle fastcgi_pass connections kept for the next request (FCGI_KEEP_CONN);
+// not watched by epoll, so a closed one is noticed when handed out again
+class FastCGIPool {
+private:
+	typedef std::map<std::string, std::vector<int> >	IdleMap;
+
+	IdleMap		idle;			// address -> connections with no request on them
+	size_t		idle_count;
+
+	static int	connect(const std::string& address);
+	static bool	isAlive(int fd);
+
+	FastCGIPool(const FastCGIPool& other);
+	FastCGIPool& operator=(const FastCGIPool& other);
+public:
+	FastCGIPool();
+	~FastCGIPool();
+	int			acquire(const std::string& address);
+	void		release(const std::string& address, int fd);
+	size_t		getIdleCount() const;
+};
+
+#endif
@@ -6,9 +6,18 @@
 
 class Location : public Config
 {
+public:
+	// nginx location modifiers; without regex locations "^~" matches like a
+	// plain prefix, it only documents the intent
+	enum Match { MATCH_PREFIX, MATCH_EXACT, MATCH_PREFIX_PRIORITY };
+
 private:
 	std::string		route;
+	Match			match;
 	std::string		alias;
+	std::string		upload_store;
+	std::string		fastcgi_pass;	// "unix:/path" or "ip:port", empty to run scripts as CGI
+	std::string		path_prefix;	// alias or root without its trailing slash, set by compile()
 
 public:
 	Location();
@@ -17,10 +26,18 @@ public:
 
 	const std::string&	getRoute() const;
 	void				setRoute(const std::string& route);
+	Match				getMatch() const;
+	void				setMatch(Match match);
 	const std::string&	getAlias() const;
 	void				setAlias(const std::string& alias);
+	const std::string&	getUploadStore() const;
+	void				setUploadStore(const std::string& upload_store);
+	const std::string&	getFastCGIPass() const;
+	void				setFastCGIPass(const std::string& fastcgi_pass);
+	std::string			mapPath(const std::string& uri) const;
 	std::string			toString() const;
 	void				inherit(const Config& src);
+	void				compile();
 };
 
 std::ostream& operator<<(std::ostream& os, const Location& location);
\ No newline at end of file
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+class Location;
+
+// Character trie over the location routes of one server. A single pass over
+// the URI returns the exact (=) location for it if there is one, otherwise
+// the longest prefix location that ends on a path segment boundary. Nodes
+// live in one vector and refer to each other by index, so matching touches
+// only the nodes on the URI's path and allocates nothing.
+//
+// The trie points into the server's locations: copies start out empty and
+// the owner rebuilds them (Server::compile()).
+class LocationTrie
+{
+private:
+	struct Node
+	{
+		std::vector<std::pair<char, int> >	children;	// first byte of the edge -> node index
+		const Location*						prefix;		// location whose route ends here
+		const Location*						exact;		// "= route" location ending here
+
+		Node();
+		int	child( char c ) const;
+	};
+
+	std::vector<Node>	_nodes;	// _nodes[0] is the empty route
+
+public:
+	LocationTrie();
+	LocationTrie( LocationTrie const& other );
+	LocationTrie&	operator=( LocationTrie const& other );
+	~LocationTrie();
+
+	void			clear();
+	void			insert( Location const& location );
+	const Location*	match( std::string const& uri ) const;
+};
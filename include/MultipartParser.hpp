@@ -0,0 +1,53 @@
+#ifndef MULTIPARTPARSER_HPP
+#define MULTIPARTPARSER_HPP
+
+#include "webserv.hpp"
+
+// Incremental multipart/form-data decoder. It is fed the request body as it
+// arrives and writes every file part straight into the upload store, so memory
+// use is bounded by one read plus one delimiter regardless of the file size.
+class MultipartParser {
+public:
+	struct SavedFile {
+		std::string	name;
+		size_t		size;
+	};
+private:
+	enum State { INACTIVE, PREAMBLE, HEADERS, DATA, DELIMITER_END, DONE, FAILED };
+
+	State					state;
+	std::string				delimiter;		// CRLF "--" boundary
+	size_t					skip[256];		// Horspool bad-character shifts for delimiter
+	std::string				window;			// bytes not yet consumed
+	std::string				store_path;
+	size_t					max_file_size;
+	int						file_fd;		// file part being written, -1 for other parts
+	std::string				file_path;
+	SavedFile				current;
+	std::vector<SavedFile>	files;
+	int						error_code;
+	std::string				error_message;
+
+	size_t					findDelimiter(size_t from) const;
+	bool					startPart(const std::string& headers);
+	bool					writeData(const char* data, size_t size);
+	void					closeFile(bool keep);
+	void					fail(int code, const std::string& message);
+
+	MultipartParser(const MultipartParser& other);
+	MultipartParser& operator=(const MultipartParser& other);
+public:
+	MultipartParser();
+	~MultipartParser();
+	bool							begin(const std::string& content_type, const std::string& store_path, size_t max_file_size);
+	void							feed(const char* data, size_t size);
+	void							reset();
+	bool							isActive() const;
+	bool							isComplete() const;
+	bool							hasFailed() const;
+	int								getErrorCode() const;
+	const std::string&				getErrorMessage() const;
+	const std::vector<SavedFile>&	getFiles() const;
+};
+
+#endif
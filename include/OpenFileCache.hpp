@@ -0,0 +1,53 @@
+#ifndef OPENFILECACHE_HPP
+#define OPENFILECACHE_HPP
+
+#include "webserv.hpp"
+#include <list>
+
+// Open descriptors and stat() results of recent paths, as in nginx's
+// open_file_cache: rechecked after `valid`, dropped after `inactive`, LRU
+class OpenFileCache {
+public:
+	struct File {
+		bool		exists;
+		bool		readable;
+		int			fd;			// regular files only, -1 otherwise; owned by the cache
+		struct stat	st;
+
+		bool		isDirectory() const;
+	};
+private:
+	typedef std::list<std::string>	LruList;
+	struct Entry {
+		File				file;
+		unsigned long		validated;	// ms, TimerWheel clock
+		unsigned long		last_used;
+		LruList::iterator	lru;
+	};
+	typedef std::map<std::string, Entry>	EntryMap;
+
+	EntryMap	entries;
+	LruList		lru;			// paths, most recently used first
+	size_t		max_entries;	// 0 disables the cache
+	unsigned long	inactive_ms;
+	File		uncached;		// result of the last lookupUncached()
+
+	static void	load(const std::string& path, File& file);
+	static void	release(File& file);
+	static bool	isSameFile(const File& file, const struct stat& st);
+	void		evict(EntryMap::iterator it);
+
+	OpenFileCache(const OpenFileCache& other);
+	OpenFileCache& operator=(const OpenFileCache& other);
+public:
+	OpenFileCache();
+	~OpenFileCache();
+	void		configure(size_t max_entries, int inactive_seconds);
+	bool		isEnabled() const;
+	const File&	lookup(const std::string& path, int valid_seconds);
+	const File&	lookupUncached(const std::string& path);
+	void		invalidate(const std::string& path);
+	void		expire(unsigned long now_ms);
+};
+
+#endif
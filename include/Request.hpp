@@ -2,56 +2,74 @@
 #define REQUEST_HPP
 
 #include "webserv.hpp"
+#include "RequestBody.hpp"
 
 // Chunked transfer encoding limits
 #define MAX_CHUNK_SIZE (50 * 1024 * 1024)  // 50MB max chunk size
 #define MAX_BODY_SIZE (100 * 1024 * 1024)  // 100MB max total body size
 #define MAX_HEADER_SIZE (8 * 1024)  // 8KB max header size
 
+class MultipartParser;
+
 class Request {
 private:
+	enum ChunkState { CHUNK_SIZE, CHUNK_DATA, CHUNK_DATA_CRLF, CHUNK_TRAILER };
+
 	std::string							method;
 	std::string							uri;
 	std::string							version;
 	std::map<std::string, std::string>	headers;
-	std::string							body;
+	RequestBody							body;
+	MultipartParser*					body_parser;		// consumes the body instead of storing it
+	size_t								body_length;		// body bytes received so far
 	std::string							query_string;
 	std::string							path_info;
 	bool								is_chunked;
 	size_t								content_length;
 	bool								is_complete;
 	std::string							buffer;
-	std::string							chunk_buffer;
-	size_t								expected_chunk_size;
-	bool								reading_chunk_size;
+	size_t								chunk_pos;			// read cursor of the chunked decoder into buffer
+	size_t								chunk_remaining;	// data bytes left in the current chunk
+	ChunkState							chunk_state;
 	bool								headers_parsed;
-	bool								waiting_final_crlf;
-	bool								reading_trailing_headers;
+	bool								body_started;
 	std::map<std::string, std::string>	trailing_headers;
 	size_t								max_body_size;
 	
 	void								parseRequestLine(const std::string& line);
 	void								parseHeader(const std::string& line);
-	void								parseChunkedBody(const std::string& data);
-	std::string							parseChunkSize(const std::string& size_line);
+	size_t								appendBody(const char* data, size_t length);
+	bool								storeBody(const char* data, size_t length);
+	void								parseBody();
+	void								parseChunkedBody();
+	static bool							parseChunkSize(const char* line, size_t length, size_t& size);
 	std::string							urlDecode(const std::string& str);
 
 public:
 	Request();
 	~Request();
 	void										parse(const std::string& raw_request);
-	void										appendData(const std::string& data);
+	void										parse(const char* data, size_t length);
+	void										appendData(const char* data, size_t length);
+	void										beginBody();
+	bool										hasHeaders() const;
+	bool										isAwaitingBody() const;
 	bool										isComplete() const;
 	bool										hasError() const;
+	bool										hasData() const;
+	bool										isKeepAlive() const;
+	std::string									takePipelinedData();
 	std::string									getErrorType() const;
 	void										reset();
 	void										setMaxBodySize(size_t max_size);
+	void										setBodyBuffer(size_t buffer_size, const std::string& temp_path);
+	void										setBodyParser(MultipartParser* parser);
 	// Getters
 	const std::string&							getMethod() const;
 	const std::string&							getUri() const;
 	const std::string&							getVersion() const;
 	const std::map<std::string, std::string>&	getHeaders() const;
-	const std::string&				       		getBody() const;
+	const RequestBody&							getBody() const;
 	const std::string&				       		getQueryString() const;
 	const std::string&				          	getPathInfo() const;
 	size_t								       	getContentLength() const;
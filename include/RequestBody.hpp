@@ -0,0 +1,36 @@
+#ifndef REQUESTBODY_HPP
+#define REQUESTBODY_HPP
+
+#include "webserv.hpp"
+
+// Request body kept in memory while it fits in buffer_size and spooled to an
+// unlinked temporary file under temp_path once it grows past that. Readers go
+// through read()/substr()/writeTo() and never care where the bytes live.
+class RequestBody {
+private:
+	std::string		memory;
+	int				fd;				// spool file, -1 while the body is in memory
+	size_t			length;
+	size_t			buffer_size;	// largest body kept in memory
+	std::string		temp_path;		// directory for spool files
+	bool			spill();
+	void			closeFile();
+public:
+	RequestBody();
+	RequestBody(const RequestBody& other);
+	RequestBody& operator=(const RequestBody& other);
+	~RequestBody();
+	void			configure(size_t buffer_size, const std::string& temp_path);
+	void			reserve(size_t size);
+	bool			append(const char* data, size_t size);
+	void			clear();
+	size_t			size() const;
+	bool			empty() const;
+	bool			isInFile() const;
+	ssize_t			read(size_t offset, char* out, size_t size) const;
+	std::string		substr(size_t offset, size_t size) const;
+	std::string		str() const;
+	bool			writeTo(int out_fd, size_t offset, size_t size) const;
+};
+
+#endif
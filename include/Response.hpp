@@ -2,34 +2,67 @@
 #define RESPONSE_HPP
 
 #include "webserv.hpp"
+#include "OpenFileCache.hpp"
+#include "StaticCache.hpp"
+
+#define MAX_BYTE_RANGES 16 // Range headers asking for more are ignored
 
 class Response {
+public:
+	struct ByteRange {
+		off_t	first;
+		off_t	last;	// inclusive
+	};
+	enum RangeStatus { RANGE_IGNORED, RANGE_SATISFIABLE, RANGE_UNSATISFIABLE };
 private:
+	// A piece of a file-backed body: either text (multipart headers) or a
+	// slice of body_fd
+	struct BodyPart {
+		std::string	text;
+		off_t		offset;		// next byte of text or of body_fd to send
+		size_t		remaining;
+	};
+
 	int									status_code;
 	std::map<std::string, std::string>	headers;
 	std::string							body;
 	std::string							status_message;
 	bool								is_sent;
 	std::string							http_version;
+	int									body_fd;		// file-backed body, streamed with sendfile()
+	std::vector<BodyPart>				body_parts;		// what is left of it, in order
+	size_t								body_part;		// part being sent
+	StaticCache::Entry*					cached_body;	// body and headers shared with the static cache
+	size_t								memory_offset;	// next byte of body or cached_body to send
+	void								releaseCachedBody();
+	void								closeFileBody();
+	void								attachDescriptor(int fd, off_t size, const std::string& filename);
+	void								addFilePart(off_t offset, size_t length);
+	void								addTextPart(const std::string& text);
+	size_t								getFileBodySize() const;
 	std::string							getContentType(const std::string& filename);
-	std::string							generateErrorPage(int code);
 	std::string							generateDirectoryListing(const std::string& path, const std::string& uri);
-	std::string							getErrorDescription(int code);
 	void								setStatusMessage();
-	bool								tryCustomErrorPage(int code, const std::map<int, std::string>& error_pages, const std::string& root_path);
-	std::string							generateTemplateErrorPage(int code, const std::string& root_path);
-	std::string							replacePlaceholders(const std::string& template_content, int code);
 public:
 	Response();
+	Response(const Response& other);
+	Response& operator=(const Response& other);
 	~Response();
 	void										setStatus(int code);
 	void										setHeader(const std::string& name, const std::string& value);
 	void										setBody(const std::string& content);
 	void										setBodyFromFile(const std::string& filename);
+	bool										attachFile(const std::string& filename);
 	// Response generation methods
-	void										sendFile(const std::string& filename);
+	void										sendFile(const std::string& filename, bool zero_copy = false);
+	void										sendFile(const std::string& filename, const OpenFileCache::File& file, bool zero_copy = false);
+	void										sendCached(StaticCache::Entry& entry);
+	void										sendNotModified(const struct stat& st);
+	void										sendRanges(const std::string& filename, const OpenFileCache::File& file, const std::vector<ByteRange>& ranges, bool zero_copy = false);
+	static RangeStatus							parseRanges(const std::string& header, off_t size, std::vector<ByteRange>& ranges);
+	void										setValidators(const struct stat& st);
 	void										sendError(int code, const std::string& custom_message = "");
-	void										sendError(int code, const ServerConfig& config, const std::string& root_path = "./www");
+	void										sendError(int code, StaticCache::Entry& page);
 	void										sendRedirect(const std::string& location);
 	void										sendDirectoryListing(const std::string& path, const std::string& uri);
 	// Nginx-specific error responses
@@ -44,7 +77,20 @@ public:
 	const std::string&							getBody() const;
 	const std::string&							getStatusMessage() const;
 	bool										isSent() const;
+	// File-backed body
+	bool										hasFileBody() const;
+	ssize_t										sendFileBody(int socket_fd, size_t max_bytes);
+	// In-memory body (body or the static cache's copy), sent in place
+	bool										hasMemoryBody() const;
+	const char*									getMemoryData() const;
+	size_t										getMemoryRemaining() const;
+	void										consumeMemoryBody(size_t bytes);
+	// Error page rendering, done once per page by the ErrorPageCache
+	static std::string							generateErrorPage(int code);
+	static std::string							getErrorDescription(int code);
+	static std::string							replacePlaceholders(const std::string& template_content, int code);
 	// Response building
+	void										buildHeaders(const std::string& request_version, const std::string& date, std::string& out) const;
 	std::string									buildResponse();
 	std::string									buildResponse(const std::string& request_version);
 	void										markAsSent();
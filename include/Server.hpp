@@ -3,6 +3,7 @@
 #include <cstdio>
 #include "Config.hpp"
 #include "Location.hpp"
+#include "LocationTrie.hpp"
 #include "default.hpp"
 
 
@@ -11,12 +12,21 @@ class Server : public Config
 {
 	private:
 		static int						num_servers; //single attributes
-		bool							_active;
 		std::string						_server_name;
+		std::vector<std::string>		_server_names;			// lowercase, as configured by server_name
 		std::string						_ip;
+		bool							_default_server;		// listen ... default_server
 		std::vector<int>                _ports;        //maps & vector attributes
 		std::map<std::string, Location>	_locations;
-		std::vector<int>				_sockets;
+		LocationTrie					_location_trie;		// routes of _locations, built by compile()
+		int								_keepalive_timeout;		// seconds an idle persistent connection is kept
+		int								_keepalive_requests;	// requests served before a connection is closed
+		int								_worker_threads;		// event loops (threads) the process runs
+		int								_open_file_cache_max;		// cached paths per event loop, 0 = off
+		int								_open_file_cache_inactive;	// seconds an unused entry is kept
+		int								_open_file_cache_valid;		// seconds before an entry is checked again
+		size_t							_static_cache_size;			// bytes of small files cached per event loop, 0 = off
+		size_t							_static_cache_max_file;		// largest file the static cache takes
 
 
 		// Sockets
@@ -26,23 +36,39 @@ class Server : public Config
 
 		Server();
 		~Server();
-		int									is_active() const;
-		std::string							get_server_name() const;
+		std::string const&					get_server_name() const;
 		void								set_server_name( std::string server_name );
-		std::string							get_ip() const;
+		std::vector<std::string> const&		get_server_names() const;
+		void								add_server_name( std::string const& server_name );
+		bool								is_default_server() const;
+		void								set_default_server( bool is_default );
+		std::string const&					get_ip() const;
 		void                                set_ip( std::string ip );
 
-		std::vector<int>                    get_ports() const;
+		std::vector<int> const&             get_ports() const;
 		void                                add_port( int port );
 		bool                                has_port( int port );
-		std::map<std::string, Location>     get_locations() const;
-		std::pair<bool, Location const*>    get_location( std::string route ) const;
+		std::map<std::string, Location> const&	get_locations() const;
+		std::pair<bool, Location const*>    get_location( std::string const& route ) const;
 		void                                add_location( std::string route, Location location );
-		std::vector<int>                    get_sockets() const;
-		bool                                has_socket( int sock ) const; //has 1 socket at minimum
+		void								compile();
+		int									get_keepalive_timeout() const;
+		void								set_keepalive_timeout( int seconds );
+		int									get_keepalive_requests() const;
+		void								set_keepalive_requests( int requests );
+		int									get_worker_threads() const;
+		void								set_worker_threads( int threads );
+		int									get_open_file_cache_max() const;
+		void								set_open_file_cache_max( int entries );
+		int									get_open_file_cache_inactive() const;
+		void								set_open_file_cache_inactive( int seconds );
+		int									get_open_file_cache_valid() const;
+		void								set_open_file_cache_valid( int seconds );
+		size_t								get_static_cache_size() const;
+		void								set_static_cache_size( size_t bytes );
+		size_t								get_static_cache_max_file() const;
+		void								set_static_cache_max_file( size_t bytes );
 		std::string							printSrv() const; //maybe superfluous
-		void								run();
-		void								shutdown();
 
 
 };
@@ -0,0 +1,64 @@
+#ifndef STATICCACHE_HPP
+#define STATICCACHE_HPP
+
+#include "webserv.hpp"
+#include "OpenFileCache.hpp"
+#include <list>
+
+// Small file bodies with their serialized header lines, sent with one
+// writev(); checked against the open file cache's inode, size and mtime, LRU
+class StaticCache {
+public:
+	// Responses retain the entry they send, so an entry evicted while a
+	// response is in flight lives until that response lets go of it
+	class Entry {
+		friend class StaticCache;
+	private:
+		std::string						headers;	// header lines, each ending in CRLF
+		std::string						body;
+		ino_t							ino;
+		dev_t							dev;
+		off_t							size;
+		time_t							mtime;
+		int								refs;
+		std::list<std::string>::iterator	lru;
+
+		Entry();
+		Entry(const Entry& other);
+		Entry& operator=(const Entry& other);
+	public:
+		static Entry*		create(const std::string& headers, const std::string& body);
+		const std::string&	getHeaders() const;
+		const std::string&	getBody() const;
+		void				retain();
+		void				release();
+	};
+private:
+	typedef std::map<std::string, Entry*>	EntryMap;
+
+	EntryMap				entries;
+	std::list<std::string>	lru;		// paths, most recently used first
+	size_t					capacity;	// bytes of headers and bodies, 0 disables the cache
+	size_t					used;
+	unsigned long			hits;
+	unsigned long			misses;
+
+	void					evict(EntryMap::iterator it);
+	static bool				isSameFile(const Entry& entry, const struct stat& st);
+	static Entry*			load(const std::string& path, const OpenFileCache::File& file);
+
+	StaticCache(const StaticCache& other);
+	StaticCache& operator=(const StaticCache& other);
+public:
+	StaticCache();
+	~StaticCache();
+	void					configure(size_t capacity);
+	bool					isEnabled() const;
+	Entry*					lookup(const std::string& path, const OpenFileCache::File& file, size_t max_file_size);
+	unsigned long			getHits() const;
+	unsigned long			getMisses() const;
+	size_t					getUsed() const;
+	size_t					getCount() const;
+};
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef TIMERWHEEL_HPP
+#define TIMERWHEEL_HPP
+
+#include <vector>
+
+// Intrusive timer entry, embedded in whatever it times out.
+// A node unlinks itself when destroyed; copies start unarmed.
+class TimerNode {
+private:
+	friend class TimerWheel;
+	TimerNode*		prev;
+	TimerNode*		next;
+	unsigned long	expires;	// tick the timer fires at
+	void*			owner;		// handed back when the timer fires
+	void			link(TimerNode& head);
+public:
+	TimerNode();
+	TimerNode(const TimerNode& other);
+	TimerNode& operator=(const TimerNode& other);
+	~TimerNode();
+	bool			isArmed() const;
+	void			cancel();
+	void*			getOwner() const;
+	void			setOwner(void* owner);
+};
+
+// Two-level hashed timer wheel (100 ms ticks). Arming and cancelling are O(1);
+// timers further than the near wheel wait in the far wheel and cascade down
+// once their block comes up.
+class TimerWheel {
+private:
+	static const unsigned long	TICK_MS = 100;
+	static const int			NEAR_BITS = 8;
+	static const int			FAR_BITS = 6;
+	static const unsigned long	NEAR_SLOTS = 1UL << NEAR_BITS;
+	static const unsigned long	FAR_SLOTS = 1UL << FAR_BITS;
+	TimerNode					near[NEAR_SLOTS];
+	TimerNode					far[FAR_SLOTS];
+	unsigned long				current;	// next tick to expire
+	void						insert(TimerNode& node);
+	void						cascade();
+	TimerWheel(const TimerWheel&);
+	TimerWheel& operator=(const TimerWheel&);
+public:
+	TimerWheel();
+	void						arm(TimerNode& node, unsigned long deadline_ms);
+	void						expire(unsigned long now_ms, std::vector<void*>& fired);
+	int							nextTimeout(unsigned long now_ms, int max_ms) const;
+	static unsigned long		now();	// monotonic clock in milliseconds
+};
+
+#endif
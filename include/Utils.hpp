@@ -32,6 +32,9 @@ public:
     static std::string					getMimeType(const std::string& filename);
     static std::string					getStatusMessage(int status_code);
     static std::string					getCurrentTime();
+    static std::string					formatHttpDate(time_t time);
+    static bool							parseHttpDate(const std::string& date, time_t& time);
+    static std::string					makeETag(const struct stat& st);
     
     // Path operations
     static std::string					joinPath(const std::string& path1, const std::string& path2);
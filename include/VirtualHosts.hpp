@@ -0,0 +1,53 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "Server.hpp"
+
+// The server blocks sharing one address:port, and the listening sockets the
+// workers accept on for it. A request's Host header picks its server by
+// name: an exact name first, then the longest leading wildcard
+// (*.example.com, or .example.com which also covers example.com), then the
+// longest trailing wildcard (www.example.*), else the default server. Names
+// are hashed into open addressing tables at startup, so a lookup costs one
+// pass over the host per dot and allocates nothing.
+class VirtualHosts
+{
+private:
+	struct Slot
+	{
+		unsigned int	hash;
+		std::string		name;	// lowercase
+		const Server*	server;	// NULL while the slot is free
+	};
+	typedef std::vector<Slot>	NameTable;
+
+	std::string					_ip;
+	int							_port;
+	std::vector<const Server*>	_servers;	// in configuration order
+	const Server*				_default;	// default_server, else the first one
+	NameTable					_exact;
+	NameTable					_leading;	// "*.example.com" stored as ".example.com"
+	NameTable					_trailing;	// "www.example.*" stored as "www.example."
+	std::vector<int>			_sockets;	// one per worker
+
+	static unsigned int	hash( const char* name, size_t length );
+	static void			insert( NameTable& table, std::string const& name, Server const& server );
+	static Server const*	find( NameTable const& table, const char* name, size_t length );
+
+public:
+	VirtualHosts( std::string const& ip, int port );
+	~VirtualHosts();
+
+	static std::vector<VirtualHosts>	group( std::vector<Server> const& servers );
+
+	std::string const&					get_ip() const;
+	int									get_port() const;
+	std::vector<const Server*> const&	get_servers() const;
+	Server const&						get_default() const;
+	void								add( Server const& server );
+	void								compile();
+	Server const&						select( std::string const& host ) const;
+	int									listen();
+	void								shutdown();
+};
@@ -5,11 +5,30 @@
 # define ALIAS_DEFAULT					""
 # define ROOT_DEFAULT					"." // Default folder where the pages will be searched
 # define AUTOINDEX_DEFAULT				false
+# define SENDFILE_DEFAULT				true // Static files are streamed with sendfile()
 # define IP_DEFAULT						"127.0.0.1"
 # define MAX_BODY_SIZE_BYTES			52428800
+# define CLIENT_BODY_BUFFER_SIZE_DEFAULT	(16 * 1024) // Larger request bodies are spooled to a temporary file
+# define CLIENT_BODY_TEMP_PATH_DEFAULT	"/tmp" // Directory for spooled request bodies
+# define UPLOAD_STORE_DEFAULT			"www/uploads" // Directory multipart file parts are written to
 # define SERVER_PROTOCOL				"HTTP/1.1"
 # define POLL_TIMEOUT                   1000 // 1 second
 # define CLIENT_TIMEOUT                 30   // 30 seconds
+# define KEEPALIVE_TIMEOUT_DEFAULT      75   // Seconds an idle keep-alive connection stays open
+# define KEEPALIVE_REQUESTS_DEFAULT     1000 // Requests served on one connection before closing it
+# define WORKER_THREADS_DEFAULT         1    // Event loops run by the process
+# define WORKER_THREADS_MAX             64
+# define OPEN_FILE_CACHE_MAX_DEFAULT    0    // Cached paths per event loop, 0 = open_file_cache off
+# define OPEN_FILE_CACHE_MAX_LIMIT      100000
+# define OPEN_FILE_CACHE_INACTIVE_DEFAULT 60 // Seconds an unused cache entry is kept
+# define OPEN_FILE_CACHE_VALID_DEFAULT  60   // Seconds before a cache entry is checked again
+# define STATIC_CACHE_SIZE_DEFAULT      0    // Bytes of small files kept in memory per event loop, 0 = off
+# define STATIC_CACHE_MAX_FILE_DEFAULT  (64 * 1024) // Larger files are always served from disk
+# define STATIC_CACHE_SIZE_MAX          (1024UL * 1024 * 1024)
+# define FASTCGI_KEEPALIVE_DEFAULT      8    // Idle connections kept per FastCGI backend and event loop
+# define CGI_SPAWN_MESSAGE_MAX          (64 * 1024) // Largest script and environment sent to the CGI zygote
+# define CGI_ZYGOTE_REAP_MS             1000 // How often the zygote collects its exited children
+# define CGI_OUTPUT_BUFFER_SIZE         (64 * 1024) // Script output read ahead of the client; also the largest header block
 
 #ifndef LOG
 # define LOG false
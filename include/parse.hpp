@@ -28,12 +28,24 @@ void							parseClientMaxBodySize( std::string line, Config &item ); // Parse ma
 void							parseErrorPageDirective( std::string line, Config &item ); // Parse custom error pages
 void							add_index( std::string line, Config &item ); // Parse index file names
 void							add_autoindex( std::string line, Config &item ); // Parse directory listing setting
+void							add_sendfile( std::string line, Config &item ); // Parse zero-copy file serving setting
+void							add_client_body_buffer_size( std::string line, Config &item ); // Parse in-memory request body limit
+void							add_client_body_temp_path( std::string line, Config &item ); // Parse request body spool directory
 void							add_return( std::string line, Config &item ); // Parse HTTP redirect
 void							add_methods( std::string line, Config &item ); // Parse allowed HTTP methods
 void							add_alias( std::string line, Config &item ); // Parse location alias
 void							add_cgi_extension( std::string line, Config &item ); // Parse CGI file extensions
 void							add_auth_basic( std::string line, Config &item ); // Parse basic auth realm
 void							add_auth_basic_user_file( std::string line, Config &item ); // Parse auth user file
+void							add_upload_store( std::string line, Config &item ); // Parse multipart upload directory
+void							add_fastcgi_pass( std::string line, Config &item ); // Parse FastCGI application address
+void							add_keepalive_timeout( std::string line, Config &item ); // Parse idle keep-alive timeout
+void							add_keepalive_requests( std::string line, Config &item ); // Parse max requests per connection
+void							add_worker_threads( std::string line, Config &item ); // Parse number of event loop threads
+void							add_open_file_cache( std::string line, Config &item ); // Parse open file cache size and inactivity
+void							add_open_file_cache_valid( std::string line, Config &item ); // Parse open file cache revalidation period
+void							add_static_cache_size( std::string line, Config &item ); // Parse static file cache budget
+void							add_static_cache_max_file( std::string line, Config &item ); // Parse largest statically cached file
 bool							is_valid_ipv4( std::string line ); // Validate IPv4 address format
 bool							is_valid_port( std::string line ); // Validate port number range
 bool							is_valid_absolute_path( std::string line ); // Validate absolute file path
@@ -1,12 +1,64 @@
 #pragma once
 
 #include "Server.hpp"
+#include "VirtualHosts.hpp"
 #include "Client.hpp"
+#include "TimerWheel.hpp"
+#include "ClientPool.hpp"
+#include "OpenFileCache.hpp"
+#include "StaticCache.hpp"
+#include "ErrorPageCache.hpp"
+#include "FastCGIPool.hpp"
+#include <pthread.h>
+#include <deque>
 
-void	polling(std::vector<Server> servers);
-void	handle_http_request(Client& client);
-void	handle_cgi_request(Client& client, const std::string& script_path, const Location& location, const Server& server);
-bool	handle_client_data(int client_fd, Client& client, int epoll_fd);
-void	process_epoll_events(int epoll_fd, struct epoll_event* events, int active_fds, std::map<int, Server>& servers, std::map<int, Client>& clients);
-void	close_clients(std::map<int, Client>& clients);
-void	check_client_timeouts(std::map<int, Client>& clients, int epoll_fd);
+// One event loop thread and the listeners it accepts on
+struct Worker
+{
+	int								id;
+	pthread_t						thread;
+	std::map<int, const VirtualHosts*>	listeners;	// this worker's SO_REUSEPORT sockets
+	int									zygote_fd;	// channel to the CGI zygote, -1 without one
+	ErrorPageCache*						error_pages;	// compiled with the configuration, shared
+};
+
+// Everything owned by one epoll loop. Only the loop's thread touches it, so
+// its caches and pools take no locks.
+struct EventLoop
+{
+	int							epoll_fd;
+	std::vector<EventSource>	listeners;		// listening sockets -> servers (shared, read-only)
+	TimerWheel					timers;			// one timer per client; outlives the clients
+	ClientPool					clients;		// connection slab, events point straight at it
+	std::vector<pid_t>			cgi_zombies;	// CGI children that closed stdout but were not reaped yet
+	OpenFileCache				open_files;		// paths served by this loop
+	StaticCache					static_files;	// small file bodies with their headers
+	ErrorPageCache*				error_pages;	// rendered error pages per server and location (shared)
+	FastCGIPool					fastcgi;		// idle connections to fastcgi_pass backends
+	int							zygote_fd;		// this loop's channel to the CGI zygote, or -1
+	EventSource					zygote;			// zygote_fd as watched by epoll
+	std::deque<Client*>			zygote_waiting;	// clients whose script the zygote is spawning, in request order; NULL once aborted
+	time_t						date_second;	// second date_header was formatted for
+	std::string					date_header;	// value of the Date header, refreshed once a second
+
+	explicit EventLoop(size_t max_clients) : epoll_fd(-1), clients(max_clients), error_pages(NULL), zygote_fd(-1), date_second(0) {}
+};
+
+void	polling(Worker& worker);
+bool	run_workers(std::vector<Worker>& workers);
+void	handle_http_request(EventLoop& loop, Client& client);
+void	handle_cgi_request(EventLoop& loop, Client& client, const std::string& script_path, const Location& location);
+void	finish_cgi_request(EventLoop& loop, Client& client);
+bool	handle_client_data(EventLoop& loop, int client_fd, Client& client);
+void	handle_cgi_event(EventLoop& loop, EventSource& source, uint32_t revents);
+void	handle_zygote_event(EventLoop& loop);
+bool	process_requests(EventLoop& loop, int client_fd, Client& client);
+bool	finish_response(EventLoop& loop, int client_fd, Client& client);
+bool	flush_client_output(EventLoop& loop, int client_fd, Client& client);
+void	update_client_events(EventLoop& loop, int client_fd, Client& client, uint32_t events);
+void	close_client(EventLoop& loop, Client& client);
+void	process_epoll_events(EventLoop& loop, struct epoll_event* events, int active_fds);
+void	close_clients(EventLoop& loop);
+void	schedule_client_timeout(EventLoop& loop, Client& client);
+void	expire_timers(EventLoop& loop);
+void	reap_cgi_zombies(EventLoop& loop);
@@ -1,4 +1,10 @@
 #pragma once
 
-extern volatile bool	sigint_pressed; //Crtl + C global
-void	set_sigint( void ); //establish sigint handler
\ No newline at end of file
+#include <csignal>
+
+// Crtl + C global. Set once by the SIGINT handler (main thread only) and never
+// cleared while workers run; every worker thread polls it at least once per
+// POLL_TIMEOUT. A worker that reads it late only stops one iteration later,
+// so no lock is needed.
+extern volatile sig_atomic_t	sigint_pressed;
+void	set_sigint( void ); //establish sigint handler
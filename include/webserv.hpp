@@ -48,6 +48,7 @@
 #define HTTP_CREATED 201
 #define HTTP_ACCEPTED 202
 #define HTTP_NO_CONTENT 204
+#define HTTP_PARTIAL_CONTENT 206
 
 // 3xx Redirection
 #define HTTP_MOVED_PERMANENTLY 301
@@ -100,14 +101,6 @@
 #define CONTENT_TYPE_PLAIN "text/plain"
 #define CONTENT_TYPE_OCTET "application/octet-stream"
 
-struct ServerConfig {
-    std::string host;
-    int port;
-    std::string server_name;
-    size_t max_body_size;
-    std::map<int, std::string> error_pages;
-};
-
 class Config;
 class Server;
 class Request;
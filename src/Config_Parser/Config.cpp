@@ -4,13 +4,17 @@
 Config::Config( void ) :
 	_client_max_body_size(CLIENT_MAX_BODY_SIZE_DEFAULT),
 	_root(ROOT_DEFAULT),
-	_autoindex(AUTOINDEX_DEFAULT)
+	_autoindex(AUTOINDEX_DEFAULT),
+	_sendfile(SENDFILE_DEFAULT),
+	_client_body_buffer_size(CLIENT_BODY_BUFFER_SIZE_DEFAULT),
+	_client_body_temp_path(CLIENT_BODY_TEMP_PATH_DEFAULT)
 {
 	_indexes.clear();
 	_error_pages.clear();
 	_return_data.code = -1; // -1 indicates no redirect configured
 	_return_data.text = "";
 	_methods.push_back("GET"); // Default to GET method only
+	_method_mask = METHOD_BIT_GET;
 	for (int i = 0; i < TOTAL_INDEX; i++)
 		_inicializated[i] = false; // Mark all fields as using default values
 }
@@ -29,6 +33,9 @@ std::string	Config::printCfg( std::string indent ) const
 	result << tab << "- Root: \"" << _root << "\"\n"; // Root directory
 	result << tab << "- Client max body: " << _client_max_body_size << "\n"; // Client max body size
 	result << tab << "- Autoindex: " << (_autoindex ? "true" : "false") << "\n"; // Autoindex setting
+	result << tab << "- Sendfile: " << (_sendfile ? "on" : "off") << "\n"; // Zero-copy static files
+	result << tab << "- Client body buffer: " << _client_body_buffer_size << "\n"; // In-memory body limit
+	result << tab << "- Client body temp path: \"" << _client_body_temp_path << "\"\n"; // Spool directory
 	result << tab << "- Index:"; // Index files
 	if (_indexes.empty()) {
 		result << " None\n";
@@ -85,7 +92,7 @@ std::ostream&	operator<<( std::ostream& os, Config const& printObject )
 	os << printObject.printCfg();
 	return (os);
 };
-std::map<int, std::string>	Config::get_error_pages( void ) const	{ return _error_pages; }
+std::map<int, std::string> const&	Config::get_error_pages( void ) const	{ return _error_pages; }
 std::string					Config::get_error_page( int code ) const
 {
 	std::map<int, std::string>::const_iterator it = _error_pages.find( code );
@@ -105,13 +112,13 @@ void	Config::set_client_max_size( size_t client_max_size )
 	_client_max_body_size = client_max_size;
 	_inicializated[CLIENT_MAX_BODY_SIZE_INDEX] = true;
 }
-std::string	Config::get_root( void ) const	{ return _root; }
+std::string const&	Config::get_root( void ) const	{ return _root; }
 void		Config::set_root( std::string root )
 {
 	_root = root;
 	_inicializated[ROOT_INDEX] = true;
 }
-std::vector<std::string>	Config::get_indexes( void ) const { return _indexes; }
+std::vector<std::string> const&	Config::get_indexes( void ) const { return _indexes; }
 void	Config::add_index( std::string index )
 {
 	if (std::find(_indexes.begin(), _indexes.end(), index) == _indexes.end())
@@ -129,30 +136,60 @@ void							Config::set_return( ReturnData data )
 	_return_data.code = data.code;
 	_return_data.text = data.text;
 }
-std::vector<std::string>	Config::get_methods( void ) const { return _methods; }
-bool						Config::has_method( std::string method ) const
+std::vector<std::string> const&	Config::get_methods( void ) const { return _methods; }
+unsigned int				Config::method_bit( std::string const& method )
 {
-	return std::find(_methods.begin(), _methods.end(), method) != _methods.end();
+	if (method == "GET")
+		return METHOD_BIT_GET;
+	if (method == "POST")
+		return METHOD_BIT_POST;
+	if (method == "DELETE")
+		return METHOD_BIT_DELETE;
+	return 0;
+}
+bool						Config::has_method( std::string const& method ) const
+{
+	return (_method_mask & method_bit(method)) != 0;
 }
 void						Config::add_method( std::string method )
 {
 	if (!_inicializated[METHODS_INDEX])
 	{
 		_methods.clear(); // Clear default GET method when first custom method added
+		_method_mask = 0;
 		_inicializated[METHODS_INDEX] = true;
 	}
 	if (has_method(method))
 		return; // Don't add duplicate methods
 	_methods.push_back(method);
+	_method_mask |= method_bit(method);
 }
-std::map<std::string, std::string>	Config::get_cgi_extensions( void ) const { return _cgi_extensions; }
+std::map<std::string, std::string> const&	Config::get_cgi_extensions( void ) const { return _cgi_extensions; }
 void								Config::add_cgi_extension( std::string extension, std::string interpreter )
 {
 	_cgi_extensions[extension] = interpreter;
 }
-std::string	Config::get_auth_basic_realm( void ) const { return _auth_basic_realm; }
+bool	Config::get_sendfile( void ) const	{ return _sendfile; }
+void	Config::set_sendfile( bool sendfile )
+{
+	_sendfile = sendfile;
+	_inicializated[SENDFILE_INDEX] = true;
+}
+size_t	Config::get_client_body_buffer_size( void ) const { return _client_body_buffer_size; }
+void	Config::set_client_body_buffer_size( size_t size )
+{
+	_client_body_buffer_size = size;
+	_inicializated[CLIENT_BODY_BUFFER_SIZE_INDEX] = true;
+}
+std::string const&	Config::get_client_body_temp_path( void ) const { return _client_body_temp_path; }
+void		Config::set_client_body_temp_path( std::string path )
+{
+	_client_body_temp_path = path;
+	_inicializated[CLIENT_BODY_TEMP_PATH_INDEX] = true;
+}
+std::string const&	Config::get_auth_basic_realm( void ) const { return _auth_basic_realm; }
 void		Config::set_auth_basic_realm( std::string realm ) { _auth_basic_realm = realm; }
-std::string	Config::get_auth_basic_user_file( void ) const { return _auth_basic_user_file; }
+std::string const&	Config::get_auth_basic_user_file( void ) const { return _auth_basic_user_file; }
 void		Config::set_auth_basic_user_file( std::string user_file ) { _auth_basic_user_file = user_file; }
 void	Config::inherit( Config const& src )
 {
@@ -162,6 +199,12 @@ void	Config::inherit( Config const& src )
 		_root = src._root;
 	if (!_inicializated[AUTOINDEX_INDEX])
 		_autoindex = src._autoindex;
+	if (!_inicializated[SENDFILE_INDEX])
+		_sendfile = src._sendfile;
+	if (!_inicializated[CLIENT_BODY_BUFFER_SIZE_INDEX])
+		_client_body_buffer_size = src._client_body_buffer_size;
+	if (!_inicializated[CLIENT_BODY_TEMP_PATH_INDEX])
+		_client_body_temp_path = src._client_body_temp_path;
 	for (std::map<int, std::string>::const_iterator it = src._error_pages.begin(); it != src._error_pages.end(); it++)
 	{
 		if (_error_pages.find(it->first) == _error_pages.end()) // Don't override existing error pages
@@ -180,10 +223,12 @@ void	Config::inherit( Config const& src )
 	if (!_inicializated[METHODS_INDEX]) // Only inherit methods if not explicitly configured
 	{
 		_methods.clear();
+		_method_mask = 0;
 		for (std::vector<std::string>::const_iterator it = src._methods.begin(); it != src._methods.end(); it++)
 		{
 			if (!has_method(*it))
 				_methods.push_back(*it);
+			_method_mask |= method_bit(*it);
 		}
 	}
 }
\ No newline at end of file
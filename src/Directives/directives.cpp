@@ -1,6 +1,7 @@
 #include "../../include/parse.hpp"
 #include "../../include/Utils.hpp"
 #include <set>
+#include <algorithm>
 #include <climits>
 #include <sstream>
 
@@ -10,7 +11,21 @@ void add_server_name(std::string serverNameValue, Config &configItem) {
 	if (serverNameValue.empty())
 		throw std::invalid_argument("server_name directive cannot be empty.");
 
-	serverConfig.set_server_name(serverNameValue);
+	// Exact names, "*.example.com", ".example.com" or "www.example.*"
+	std::istringstream namesStream(serverNameValue);
+	std::string serverName;
+	while (std::getline(namesStream, serverName, ' ')) {
+		if (serverName.empty())
+			continue;
+		size_t wildcards = std::count(serverName.begin(), serverName.end(), '*');
+		bool leading = serverName.compare(0, 2, "*.") == 0;
+		bool trailing = serverName.length() > 2 && serverName.compare(serverName.length() - 2, 2, ".*") == 0;
+		if (wildcards > 1 || (wildcards == 1 && !leading && !trailing))
+			throw std::invalid_argument("Invalid server_name directive. Wildcards must be \"*.name\" or \"name.*\".");
+		if (serverName == "." || serverName == "*.")
+			throw std::invalid_argument("Invalid server_name directive. \"" + serverName + "\" names no host.");
+		serverConfig.add_server_name(serverName);
+	}
 }
 
 void add_address(std::string addressValue, Config &configItem) {
@@ -36,7 +51,9 @@ void add_listen(std::string portsValue, Config &configItem) {
 	std::istringstream portsStream(portsValue);
 	std::string portString;
 	while (std::getline(portsStream, portString, ' ')) {
-		if (is_valid_port(portString)) {
+		if (portString == "default_server") {
+			serverConfig.set_default_server(true);
+		} else if (is_valid_port(portString)) {
 			char *conversionEnd;
 			long portNumber = strtol(portString.c_str(), &conversionEnd, 10);
 			serverConfig.add_port(static_cast<int>(portNumber));
@@ -182,7 +199,56 @@ void add_autoindex(std::string autoindexValue, Config &configItem) {
 		throw std::invalid_argument("Invalid autoindex directive. Accepted values are [ true, false ].");
 }
 
+void add_sendfile(std::string sendfileValue, Config &configItem) {
+	if (sendfileValue.empty())
+		throw std::invalid_argument("sendfile directive cannot be empty.");
+
+	std::string lowerCaseValue = Utils::toLower(sendfileValue);
+	if (lowerCaseValue.compare("on") == 0)
+		configItem.set_sendfile(true);
+	else if (lowerCaseValue.compare("off") == 0)
+		configItem.set_sendfile(false);
+	else
+		throw std::invalid_argument("Invalid sendfile directive. Accepted values are [ on, off ].");
+}
+
+void add_client_body_buffer_size(std::string sizeValue, Config &configItem) {
+	if (sizeValue.empty() || sizeValue.at(0) == '-')
+		throw std::invalid_argument("client_body_buffer_size directive cannot be empty or a negative number.");
+
+	char *conversionEnd;
+	unsigned long bufferSize = strtoul(sizeValue.c_str(), &conversionEnd, 10);
+	std::string sizeSuffix(conversionEnd);
+	if (sizeSuffix == "k" || sizeSuffix == "K")
+		bufferSize *= 1024;
+	else if (sizeSuffix == "m" || sizeSuffix == "M")
+		bufferSize *= 1024 * 1024;
+	else if (!sizeSuffix.empty())
+		throw std::invalid_argument("Invalid client_body_buffer_size directive. Accepted suffix are [ k, K, m, M ].");
+
+	if (conversionEnd == sizeValue.c_str() || bufferSize > MAX_BODY_SIZE_BYTES)
+		throw std::invalid_argument("Invalid client_body_buffer_size directive. Size must be between 0 and 50 MB.");
+
+	configItem.set_client_body_buffer_size(bufferSize);
+}
 
+void add_client_body_temp_path(std::string pathValue, Config &configItem) {
+	if (pathValue.empty())
+		throw std::invalid_argument("client_body_temp_path directive cannot be empty.");
+
+	std::string resolvedTempPath = pathValue;
+	if (!is_valid_absolute_path(pathValue)) {
+		resolvedTempPath = Utils::getAbsolutePath(pathValue);
+		if (resolvedTempPath.empty())
+			throw std::invalid_argument("Invalid client_body_temp_path directive. Cannot resolve path.");
+	}
+	if (!Utils::isDirectory(resolvedTempPath) || access(resolvedTempPath.c_str(), W_OK) != 0)
+		throw std::invalid_argument("Invalid client_body_temp_path directive. Path must be a writable directory.");
+
+	if (resolvedTempPath != "/" && resolvedTempPath.at(resolvedTempPath.size() - 1) == '/')
+		resolvedTempPath = resolvedTempPath.substr(0, resolvedTempPath.size() - 1);
+	configItem.set_client_body_temp_path(resolvedTempPath);
+}
 
 void add_return(std::string returnValue, Config &configItem) {
 	if (returnValue.empty())
@@ -251,6 +317,50 @@ void add_alias(std::string aliasValue, Config &configItem) {
 		resolvedAliasPath.at(resolvedAliasPath.size() - 1) != '/' ? locationConfig.setAlias(resolvedAliasPath) : locationConfig.setAlias(resolvedAliasPath.substr(0, resolvedAliasPath.size() - 1));
 }
 
+void add_upload_store(std::string storeValue, Config &configItem) {
+	Location &locationConfig = static_cast<Location &>(configItem);
+
+	if (storeValue.empty())
+		throw std::invalid_argument("upload_store directive cannot be empty.");
+
+	std::string resolvedStorePath = storeValue;
+	if (!is_valid_absolute_path(storeValue)) {
+		resolvedStorePath = Utils::getAbsolutePath(storeValue);
+		if (resolvedStorePath.empty())
+			throw std::invalid_argument("Invalid upload_store directive. Cannot resolve path.");
+	}
+	if (!Utils::isDirectory(resolvedStorePath) || access(resolvedStorePath.c_str(), W_OK) != 0)
+		throw std::invalid_argument("Invalid upload_store directive. Path must be a writable directory.");
+
+	if (resolvedStorePath != "/" && resolvedStorePath.at(resolvedStorePath.size() - 1) == '/')
+		resolvedStorePath = resolvedStorePath.substr(0, resolvedStorePath.size() - 1);
+	locationConfig.setUploadStore(resolvedStorePath);
+}
+
+void add_fastcgi_pass(std::string passValue, Config &configItem) {
+	Location &locationConfig = static_cast<Location &>(configItem);
+
+	if (passValue.empty())
+		throw std::invalid_argument("fastcgi_pass directive cannot be empty.");
+
+	if (passValue.compare(0, 5, "unix:") == 0) {
+		if (passValue.length() == 5 || !is_valid_absolute_path(passValue.substr(5)))
+			throw std::invalid_argument("Invalid fastcgi_pass directive. Socket path must be absolute.");
+		locationConfig.setFastCGIPass(passValue);
+		return;
+	}
+
+	size_t colonPos = passValue.rfind(':');
+	if (colonPos == std::string::npos || !is_valid_port(passValue.substr(colonPos + 1)))
+		throw std::invalid_argument("Invalid fastcgi_pass directive. Format must be: fastcgi_pass unix:/path; or fastcgi_pass address:port;");
+	std::string address = passValue.substr(0, colonPos);
+	if (address.compare("localhost") == 0)
+		address = IP_DEFAULT;
+	else if (!is_valid_ipv4(address))
+		throw std::invalid_argument("Invalid fastcgi_pass directive. Address must be a valid IPv4.");
+	locationConfig.setFastCGIPass(address + passValue.substr(colonPos));
+}
+
 void add_cgi_extension(std::string cgiValue, Config &configItem) {
 	if (cgiValue.empty())
 		throw std::invalid_argument("cgi_extension directive cannot be empty.");
@@ -284,3 +394,150 @@ void add_auth_basic_user_file(std::string userFilePath, Config &configItem) {
 
 	configItem.set_auth_basic_user_file(userFilePath);
 }
+
+void add_keepalive_timeout(std::string timeoutValue, Config &configItem) {
+	Server &serverConfig = static_cast<Server &>(configItem);
+
+	if (timeoutValue.empty())
+		throw std::invalid_argument("keepalive_timeout directive cannot be empty.");
+
+	char *conversionEnd;
+	long timeoutSeconds = strtol(timeoutValue.c_str(), &conversionEnd, 10);
+	if (*conversionEnd == 's')
+		++conversionEnd;
+	if (*conversionEnd != '\0' || timeoutSeconds < 0 || timeoutSeconds > 3600)
+		throw std::invalid_argument("Invalid keepalive_timeout directive. Timeout must be between 0 and 3600 seconds (0 disables keep-alive).");
+
+	serverConfig.set_keepalive_timeout(static_cast<int>(timeoutSeconds));
+}
+
+void add_keepalive_requests(std::string requestsValue, Config &configItem) {
+	Server &serverConfig = static_cast<Server &>(configItem);
+
+	if (requestsValue.empty())
+		throw std::invalid_argument("keepalive_requests directive cannot be empty.");
+
+	char *conversionEnd;
+	long maxRequests = strtol(requestsValue.c_str(), &conversionEnd, 10);
+	if (*conversionEnd != '\0' || maxRequests < 1 || maxRequests > 1000000)
+		throw std::invalid_argument("Invalid keepalive_requests directive. Value must be between 1 and 1000000.");
+
+	serverConfig.set_keepalive_requests(static_cast<int>(maxRequests));
+}
+
+void add_worker_threads(std::string threadsValue, Config &configItem) {
+	Server &serverConfig = static_cast<Server &>(configItem);
+
+	if (threadsValue.empty())
+		throw std::invalid_argument("worker_threads directive cannot be empty.");
+
+	char *conversionEnd;
+	long threadCount = strtol(threadsValue.c_str(), &conversionEnd, 10);
+	if (*conversionEnd != '\0' || threadCount < 1 || threadCount > WORKER_THREADS_MAX)
+		throw std::invalid_argument("Invalid worker_threads directive. Value must be between 1 and 64.");
+
+	serverConfig.set_worker_threads(static_cast<int>(threadCount));
+}
+
+// Durations in seconds, with an optional s (seconds) or m (minutes) suffix
+static bool parse_seconds(const std::string& value, long& seconds) {
+	char *conversionEnd;
+	seconds = strtol(value.c_str(), &conversionEnd, 10);
+	if (conversionEnd == value.c_str())
+		return false;
+	if (*conversionEnd == 'm') {
+		seconds *= 60;
+		++conversionEnd;
+	} else if (*conversionEnd == 's')
+		++conversionEnd;
+	return *conversionEnd == '\0' && seconds >= 0 && seconds <= 3600;
+}
+
+void add_open_file_cache(std::string cacheValue, Config &configItem) {
+	Server &serverConfig = static_cast<Server &>(configItem);
+
+	if (cacheValue.empty())
+		throw std::invalid_argument("open_file_cache directive cannot be empty.");
+	if (cacheValue == "off") {
+		serverConfig.set_open_file_cache_max(0);
+		return;
+	}
+
+	std::istringstream cacheStream(cacheValue);
+	std::string parameter;
+	long maxEntries = -1;
+	long inactiveSeconds = OPEN_FILE_CACHE_INACTIVE_DEFAULT;
+	while (cacheStream >> parameter) {
+		if (parameter.compare(0, 4, "max=") == 0) {
+			char *conversionEnd;
+			maxEntries = strtol(parameter.c_str() + 4, &conversionEnd, 10);
+			if (*conversionEnd != '\0' || parameter.size() == 4 || maxEntries < 1 || maxEntries > OPEN_FILE_CACHE_MAX_LIMIT)
+				throw std::invalid_argument("Invalid open_file_cache directive. max must be between 1 and 100000.");
+		} else if (parameter.compare(0, 9, "inactive=") == 0) {
+			if (!parse_seconds(parameter.substr(9), inactiveSeconds) || inactiveSeconds == 0)
+				throw std::invalid_argument("Invalid open_file_cache directive. inactive must be between 1 second and 60 minutes.");
+		} else {
+			throw std::invalid_argument("Invalid open_file_cache directive. Format must be: open_file_cache off; or open_file_cache max=N [inactive=time];");
+		}
+	}
+	if (maxEntries == -1)
+		throw std::invalid_argument("Invalid open_file_cache directive. max parameter is required.");
+
+	serverConfig.set_open_file_cache_max(static_cast<int>(maxEntries));
+	serverConfig.set_open_file_cache_inactive(static_cast<int>(inactiveSeconds));
+}
+
+void add_open_file_cache_valid(std::string validValue, Config &configItem) {
+	Server &serverConfig = static_cast<Server &>(configItem);
+
+	if (validValue.empty())
+		throw std::invalid_argument("open_file_cache_valid directive cannot be empty.");
+
+	long validSeconds;
+	if (!parse_seconds(validValue, validSeconds))
+		throw std::invalid_argument("Invalid open_file_cache_valid directive. Time must be between 0 and 60 minutes.");
+
+	serverConfig.set_open_file_cache_valid(static_cast<int>(validSeconds));
+}
+
+// Sizes in bytes, with an optional k or m suffix
+static bool parse_size(const std::string& value, unsigned long& size) {
+	if (value.empty() || value.at(0) == '-')
+		return false;
+	char *conversionEnd;
+	size = strtoul(value.c_str(), &conversionEnd, 10);
+	std::string sizeSuffix(conversionEnd);
+	if (sizeSuffix == "k" || sizeSuffix == "K")
+		size *= 1024;
+	else if (sizeSuffix == "m" || sizeSuffix == "M")
+		size *= 1024 * 1024;
+	else if (!sizeSuffix.empty())
+		return false;
+	return conversionEnd != value.c_str();
+}
+
+void add_static_cache_size(std::string sizeValue, Config &configItem) {
+	Server &serverConfig = static_cast<Server &>(configItem);
+
+	if (sizeValue.empty())
+		throw std::invalid_argument("static_cache_size directive cannot be empty.");
+
+	unsigned long cacheSize;
+	if (!parse_size(sizeValue, cacheSize) || cacheSize > STATIC_CACHE_SIZE_MAX)
+		throw std::invalid_argument("Invalid static_cache_size directive. Size must be between 0 and 1024 MB (k and m suffixes accepted, 0 disables the cache).");
+
+	serverConfig.set_static_cache_size(cacheSize);
+}
+
+void add_static_cache_max_file(std::string sizeValue, Config &configItem) {
+	Server &serverConfig = static_cast<Server &>(configItem);
+
+	if (sizeValue.empty())
+		throw std::invalid_argument("static_cache_max_file directive cannot be empty.");
+
+	unsigned long maxFileSize;
+	if (!parse_size(sizeValue, maxFileSize) || maxFileSize > STATIC_CACHE_SIZE_MAX)
+		throw std::invalid_argument("Invalid static_cache_max_file directive. Size must be between 0 and 1024 MB (k and m suffixes accepted).");
+
+	serverConfig.set_static_cache_max_file(maxFileSize);
+}
@@ -12,8 +12,18 @@ std::map<std::string, Function> get_server_directives() {
 	serverDirectiveHandlers["error_page "] = parseErrorPageDirective;
 	serverDirectiveHandlers["index "] = add_index;
 	serverDirectiveHandlers["autoindex "] = add_autoindex;
+	serverDirectiveHandlers["sendfile "] = add_sendfile;
+	serverDirectiveHandlers["client_body_buffer_size "] = add_client_body_buffer_size;
+	serverDirectiveHandlers["client_body_temp_path "] = add_client_body_temp_path;
 	serverDirectiveHandlers["return "] = add_return;
 	serverDirectiveHandlers["methods "] = add_methods;
+	serverDirectiveHandlers["keepalive_timeout "] = add_keepalive_timeout;
+	serverDirectiveHandlers["keepalive_requests "] = add_keepalive_requests;
+	serverDirectiveHandlers["worker_threads "] = add_worker_threads;
+	serverDirectiveHandlers["open_file_cache "] = add_open_file_cache;
+	serverDirectiveHandlers["open_file_cache_valid "] = add_open_file_cache_valid;
+	serverDirectiveHandlers["static_cache_size "] = add_static_cache_size;
+	serverDirectiveHandlers["static_cache_max_file "] = add_static_cache_max_file;
 
 	return serverDirectiveHandlers;
 }
@@ -27,11 +37,16 @@ std::map<std::string, Function> get_location_directives() {
 	locationDirectiveHandlers["error_page "] = parseErrorPageDirective;
 	locationDirectiveHandlers["index "] = add_index;
 	locationDirectiveHandlers["autoindex "] = add_autoindex;
+	locationDirectiveHandlers["sendfile "] = add_sendfile;
+	locationDirectiveHandlers["client_body_buffer_size "] = add_client_body_buffer_size;
+	locationDirectiveHandlers["client_body_temp_path "] = add_client_body_temp_path;
 	locationDirectiveHandlers["return "] = add_return;
 	locationDirectiveHandlers["methods "] = add_methods;
 	locationDirectiveHandlers["cgi_extension "] = add_cgi_extension;
 	locationDirectiveHandlers["auth_basic "] = add_auth_basic;
 	locationDirectiveHandlers["auth_basic_user_file "] = add_auth_basic_user_file;
+	locationDirectiveHandlers["upload_store "] = add_upload_store;
+	locationDirectiveHandlers["fastcgi_pass "] = add_fastcgi_pass;
 
 	return locationDirectiveHandlers;
 }
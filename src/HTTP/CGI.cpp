@@ -1,5 +1,7 @@
 #include "../../include/CGI.hpp"
 #include "../../include/Utils.hpp"
+#include "../../include/CGIZygote.hpp"
+#include "../../include/default.hpp"
 #include <sstream>
 #include <cstdlib>
 #include <unistd.h>
@@ -7,10 +9,34 @@
 #include <fcntl.h>
 #include <signal.h>
 #include <cstring>
+#include <strings.h>
 #include <ctime>
 #include <sys/resource.h>
+#include <cerrno>
+#include <sys/socket.h>
+#include <pthread.h>
 
-CGI::CGI() {
+// FastCGI 1.0 (responder role): the record types and values the server uses
+enum {
+    FCGI_VERSION_1 = 1,
+    FCGI_HEADER_LEN = 8,
+    FCGI_MAX_CONTENT = 65535,
+    FCGI_REQUEST_ID = 1,        // one request at a time per connection
+    FCGI_BEGIN_REQUEST = 1,
+    FCGI_END_REQUEST = 3,
+    FCGI_PARAMS = 4,
+    FCGI_STDIN = 5,
+    FCGI_STDOUT = 6,
+    FCGI_STDERR = 7,
+    FCGI_RESPONDER = 1,
+    FCGI_KEEP_CONN = 1,
+    FCGI_REQUEST_COMPLETE = 0
+};
+
+CGI::CGI() : request(NULL), pid(-1), pidfd(-1), spawning(false), stdin_fd(-1), stdout_fd(-1), stderr_fd(-1), input_offset(0),
+             header_state(HEADERS_PENDING), body_left(std::string::npos),
+             backend_fd(-1), backend_out_offset(0), backend_stdin_done(false), backend_ended(false),
+             run_deadline(0) {
     gateway_interface = "CGI/1.1";
     server_software = "WebServer/1.0";
     server_protocol = "HTTP/1.1";
@@ -29,7 +55,9 @@ void CGI::setScriptPath(const std::string& path) {
     script_name = Utils::getBasename(path);
 }
 
+// The request must outlive the script: its body is read as it arrives
 void CGI::setRequest(const Request& request) {
+    this->request = &request;
     request_method = request.getMethod();
     query_string = request.getQueryString();
     content_type = request.getHeader("Content-Type");
@@ -42,7 +70,6 @@ void CGI::setRequest(const Request& request) {
     http_host = request.getHeader("Host");
     path_info = request.getPathInfo();
     request_uri = request.getUri();
-    request_body = request.getBody();
 }
 
 void CGI::setDocumentRoot(const std::string& root) {
@@ -58,16 +85,58 @@ void CGI::setInterpreter(const std::string& interpreter) {
     interpreter_path = interpreter;
 }
 
-std::string CGI::execute() {
+void CGI::setRunDeadline(unsigned long deadline) {
+    run_deadline = deadline;
+}
+
+unsigned long CGI::getRunDeadline() const {
+    return run_deadline;
+}
+
+// Starts the script through the zygote on zygote_fd when there is one, and
+// spawns it from the server otherwise (or if the zygote cannot take the
+// request). A script asked of the zygote is spawning until its answer is
+// handed to adoptSpawned().
+bool CGI::start(int zygote_fd) {
     if (!isValidScript(script_path)) {
-        return "";
+        return false;
     }
     
     setupEnvironment();
-    return executeScript();
+    if (zygote_fd != -1 && requestFromZygote(zygote_fd)) {
+        spawning = true;
+        return true;
+    }
+    return spawnScript();
+}
+
+bool CGI::requestFromZygote(int zygote_fd) {
+    std::string message;
+    message.append(interpreter_path).append(1, '\0');
+    message.append(script_path).append(1, '\0');
+    for (std::map<std::string, std::string>::const_iterator it = env_vars.begin(); it != env_vars.end(); ++it) {
+        message.append(it->first).append(1, '=').append(it->second).append(1, '\0');
+    }
+    return CGIZygote::request(zygote_fd, message);
 }
 
+// Takes over the child the zygote started: its pid, then stdin, stdout,
+// stderr and its pidfd in fds. Without a child (child <= 0: the zygote could
+// not start it or is gone) the server spawns the script itself.
+bool CGI::adoptSpawned(pid_t child, const int fds[4]) {
+    spawning = false;
+    if (child <= 0) {
+        return spawnScript();
+    }
+    pid = child;
+    pidfd = fds[3];
+    adoptPipes(fds[0], fds[1], fds[2]);
+    return true;
+}
 
+bool CGI::isSpawning() const {
+    return spawning;
+}
 
 void CGI::setupEnvironment() {
     env_vars.clear();
@@ -86,6 +155,7 @@ void CGI::setupEnvironment() {
     env_vars["REMOTE_HOST"] = remote_host;
     env_vars["REQUEST_URI"] = request_uri;
     env_vars["DOCUMENT_ROOT"] = document_root;
+    env_vars["SCRIPT_FILENAME"] = script_path;
     
     // Optional meta-variables
     if (!path_info.empty()) {
@@ -130,130 +200,494 @@ void CGI::freeEnvArray(char** env) {
     delete[] env;
 }
 
-std::string CGI::executeScript() {
+bool CGI::spawnScript() {
     int pipe_in[2], pipe_out[2], pipe_err[2];
     
-    if (pipe(pipe_in) == -1 || pipe(pipe_out) == -1 || pipe(pipe_err) == -1) {
-        return "";
+    if (pipe2(pipe_in, O_CLOEXEC) == -1) {
+        return false;
     }
-    
-    pid_t pid = fork();
-    if (pid == -1) {
+    if (pipe2(pipe_out, O_CLOEXEC) == -1) {
+        close(pipe_in[0]); close(pipe_in[1]);
+        return false;
+    }
+    if (pipe2(pipe_err, O_CLOEXEC) == -1) {
         close(pipe_in[0]); close(pipe_in[1]);
         close(pipe_out[0]); close(pipe_out[1]);
-        close(pipe_err[0]); close(pipe_err[1]);
-        return "";
+        return false;
     }
     
-    if (pid == 0) {
-        // Child process
-        close(pipe_in[1]); // Close write end
-        close(pipe_out[0]); // Close read end
-        close(pipe_err[0]); // Close read end
-        
-        // Redirect stdin, stdout, and stderr
-        dup2(pipe_in[0], STDIN_FILENO);
-        dup2(pipe_out[1], STDOUT_FILENO);
-        dup2(pipe_err[1], STDERR_FILENO);
-        
-        // Close unused file descriptors
-        close(pipe_in[0]);
-        close(pipe_out[1]);
-        close(pipe_err[1]);
-        
-        // Set up environment
-        char** env = createEnvArray();
-        
-        // Change to script directory for relative path resolution
-        std::string script_dir = Utils::getDirname(script_path);
-        if (!script_dir.empty()) {
-            if (chdir(script_dir.c_str()) != 0) {
-                // If chdir fails, exit child process
-                freeEnvArray(env);
-                exit(1);
+    char** env = createEnvArray();
+    int child_fds[3] = { pipe_in[0], pipe_out[1], pipe_err[1] };
+    pid = spawnProcess(interpreter_path.c_str(), script_path.c_str(), env, child_fds);
+    freeEnvArray(env);
+    
+    // The child has its own copies of its ends now
+    close(pipe_in[0]);
+    close(pipe_out[1]);
+    close(pipe_err[1]);
+    if (pid == -1) {
+        close(pipe_in[1]);
+        close(pipe_out[0]);
+        close(pipe_err[0]);
+        return false;
+    }
+    
+    adoptPipes(pipe_in[1], pipe_out[0], pipe_err[0]);
+    return true;
+}
+
+// What the child of spawnProcess() does between vfork() and exec. All of it
+// is prepared beforehand: the child shares the caller's memory and stack, and
+// may only make system calls.
+struct SpawnPlan {
+    const char* program;
+    char** argv;
+    char** env;
+    const int* child_fds;
+    const char* directory; // NULL to stay where the server is
+    struct rlimit cpu_limit;
+    struct rlimit memory_limit;
+    volatile int error; // set by the child if it could not exec
+};
+
+// Signals the server ignores or blocks must reach the script as usual
+static const int spawn_default_signals[] = { SIGPIPE, SIGINT, SIGCHLD };
+
+static void exec_child(SpawnPlan& plan) {
+    if (setrlimit(RLIMIT_CPU, &plan.cpu_limit) == -1 || setrlimit(RLIMIT_AS, &plan.memory_limit) == -1) {
+        plan.error = errno;
+        _exit(127);
+    }
+    for (int i = 0; i < 3; ++i) {
+        int moved = (plan.child_fds[i] == i) ? fcntl(i, F_SETFD, 0) : dup2(plan.child_fds[i], i);
+        if (moved == -1) {
+            plan.error = errno;
+            _exit(127);
+        }
+    }
+    // Change to script directory for relative path resolution
+    if (plan.directory && chdir(plan.directory) == -1) {
+        plan.error = errno;
+        _exit(127);
+    }
+    struct sigaction default_action;
+    memset(&default_action, 0, sizeof(default_action));
+    default_action.sa_handler = SIG_DFL;
+    for (size_t i = 0; i < sizeof(spawn_default_signals) / sizeof(spawn_default_signals[0]); ++i) {
+        sigaction(spawn_default_signals[i], &default_action, NULL);
+    }
+    sigset_t unblocked;
+    sigemptyset(&unblocked);
+    sigprocmask(SIG_SETMASK, &unblocked, NULL);
+    execve(plan.program, plan.argv, plan.env);
+    plan.error = errno;
+    _exit(127);
+}
+
+// The caller is suspended until the child has exec'd or exited, so plan.error
+// is final once vfork() returns here. No handler may run in the child while
+// it borrows this thread's stack: every signal stays blocked until exec.
+static pid_t spawn_child(SpawnPlan& plan) {
+    sigset_t all, saved;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &saved);
+    pid_t child = vfork();
+    if (child == 0) {
+        exec_child(plan);
+    }
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+    return child;
+}
+
+// Runs the interpreter (or the script itself) with child_fds as its stdin,
+// stdout and stderr, from the script's directory and under the CGI resource
+// limits. vfork() does not copy the caller's page tables, and as every other
+// descriptor is close-on-exec the script gets these three only. The child
+// sets its limits before exec, so the script never runs without them; if any
+// step fails it exits instead of running the script.
+// Returns the child's pid, or -1 if it could not be started.
+pid_t CGI::spawnProcess(const char* interpreter, const char* script, char** env, const int child_fds[3]) {
+    std::string script_dir = Utils::getDirname(script);
+    const char* program = *interpreter ? interpreter : script;
+    char* argv[] = { const_cast<char*>(program), *interpreter ? const_cast<char*>(script) : NULL, NULL };
+
+    SpawnPlan plan;
+    plan.program = program;
+    plan.argv = argv;
+    plan.env = env;
+    plan.child_fds = child_fds;
+    plan.directory = script_dir.empty() ? NULL : script_dir.c_str();
+    plan.cpu_limit.rlim_cur = 60;  // 60 seconds CPU time limit
+    plan.cpu_limit.rlim_max = 60;
+    plan.memory_limit.rlim_cur = 50 * 1024 * 1024;  // 50MB memory limit
+    plan.memory_limit.rlim_max = 50 * 1024 * 1024;
+    plan.error = 0;
+
+    pid_t child = spawn_child(plan);
+    if (child == -1) {
+        return -1;
+    }
+    if (plan.error != 0) {
+        waitpid(child, NULL, 0);
+        return -1;
+    }
+    return child;
+}
+
+// Takes over the server ends of a started script's pipes
+void CGI::adoptPipes(int in, int out, int err) {
+    stdin_fd = in;
+    stdout_fd = out;
+    stderr_fd = err;
+    input_offset = 0;
+    output.clear();
+    header_state = HEADERS_PENDING;
+    body_left = std::string::npos;
+    
+    // The epoll loop drives all three pipes, so none of them may block
+    fcntl(stdin_fd, F_SETFL, O_NONBLOCK);
+    fcntl(stdout_fd, F_SETFL, O_NONBLOCK);
+    fcntl(stderr_fd, F_SETFL, O_NONBLOCK);
+    
+    // Nothing to send: let the script see EOF on stdin right away
+    if (request->isComplete() && request->getBody().empty()) {
+        closeStdin();
+    }
+}
+
+// Writes as much of the request body as has arrived and the pipe accepts.
+// stdin is closed once the whole body is out, or if the script stopped reading.
+CGI::InputState CGI::writeInput() {
+    if (stdin_fd == -1) {
+        return INPUT_DONE;
+    }
+    
+    // The body may be spooled to a file: feed it through a pipe-sized window
+    const RequestBody& body = request->getBody();
+    char chunk[BUFFER_SIZE * 16];
+    while (input_offset < body.size()) {
+        ssize_t available = body.read(input_offset, chunk, sizeof(chunk));
+        if (available <= 0) {
+            break; // Spool file read failed
+        }
+        ssize_t written = write(stdin_fd, chunk, available);
+        if (written <= 0) {
+            if (written == -1 && errno == EAGAIN) {
+                return INPUT_BLOCKED; // Pipe full, wait for the next EPOLLOUT
             }
+            break; // Script closed its stdin or write failed
         }
-        
-        // Set resource limits for security
-        struct rlimit rl;
-        rl.rlim_cur = 60;  // 60 seconds CPU time limit
-        rl.rlim_max = 60;
-        setrlimit(RLIMIT_CPU, &rl);
-        
-        rl.rlim_cur = 50 * 1024 * 1024;  // 50MB memory limit
-        rl.rlim_max = 50 * 1024 * 1024;
-        setrlimit(RLIMIT_AS, &rl);
-        
-        // Execute the script with proper environment using execve
-        if (!interpreter_path.empty()) {
-            char* argv[] = { (char*)interpreter_path.c_str(), (char*)script_path.c_str(), NULL };
-            execve(interpreter_path.c_str(), argv, env);
+        input_offset += written;
+    }
+    if (input_offset == body.size() && !request->isComplete()) {
+        return INPUT_STARVED; // The client is still uploading
+    }
+    
+    closeStdin();
+    return INPUT_DONE;
+}
+
+// Reads whatever the script has produced so far.
+// Returns the number of bytes read, 0 on EOF and -1 if no data is available yet.
+ssize_t CGI::readOutput() {
+    char buffer[BUFFER_SIZE * 4];
+    ssize_t bytes_read = read(stdout_fd, buffer, sizeof(buffer));
+    
+    if (bytes_read > 0) {
+        output.append(buffer, bytes_read);
+        splitHeaders(false);
+    } else if (bytes_read == -1 && errno != EAGAIN) {
+        bytes_read = 0; // Treat read errors as end of output
+    }
+    return bytes_read;
+}
+
+// Drains the script's stderr so it never blocks on a full pipe
+ssize_t CGI::readErrors() {
+    char buffer[BUFFER_SIZE];
+    ssize_t bytes_read = read(stderr_fd, buffer, sizeof(buffer));
+    
+    if (bytes_read > 0 && LOG) {
+        std::cerr << "[CGI " << script_name << "] " << std::string(buffer, bytes_read);
+    } else if (bytes_read == -1 && errno != EAGAIN) {
+        bytes_read = 0;
+    }
+    return bytes_read;
+}
+
+void CGI::closeFd(int& fd) {
+    if (fd != -1) {
+        close(fd);
+        fd = -1;
+    }
+}
+
+void CGI::closeStdin() {
+    closeFd(stdin_fd);
+}
+
+void CGI::closeStdout() {
+    closeFd(stdout_fd);
+}
+
+void CGI::closeStderr() {
+    closeFd(stderr_fd);
+}
+
+// Non-blocking reap of the child. Returns true once it has been collected.
+// The zygote collects its own children: those are only let go of.
+bool CGI::reap() {
+    if (pidfd != -1) {
+        closeFd(pidfd);
+        pid = -1;
+    }
+    if (pid <= 0) {
+        return true;
+    }
+    pid_t result = waitpid(pid, NULL, WNOHANG);
+    if (result == 0) {
+        return false;
+    }
+    pid = -1;
+    return true;
+}
+
+// Kills the script and releases every pipe (timeouts, client disconnects).
+// A script the zygote is still spawning is killed by the event loop once its
+// answer arrives.
+void CGI::terminate() {
+    spawning = false;
+    closeStdin();
+    closeStdout();
+    closeStderr();
+    closeBackend();
+    if (pidfd != -1) {
+        CGIZygote::kill(pidfd, SIGKILL);
+        closeFd(pidfd);
+        pid = -1;
+    }
+    if (pid > 0) {
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        pid = -1;
+    }
+}
+
+// Called once the output ended: whatever has no header block is all body
+bool CGI::finish() {
+    splitHeaders(true);
+    return header_state == HEADERS_READY;
+}
+
+bool CGI::isRunning() const {
+    return spawning || stdin_fd != -1 || stdout_fd != -1 || stderr_fd != -1 || backend_fd != -1;
+}
+
+pid_t CGI::getPid() const {
+    return pid;
+}
+
+int CGI::getStdinFd() const {
+    return stdin_fd;
+}
+
+int CGI::getStdoutFd() const {
+    return stdout_fd;
+}
+
+int CGI::getStderrFd() const {
+    return stderr_fd;
+}
+
+// Hands the request to a FastCGI application instead of running the script:
+// the variables a child would get become FCGI_PARAMS, the body FCGI_STDIN.
+// fd is a connection to address, possibly still connecting.
+void CGI::startFastCGI(const std::string& address, int fd) {
+    setupEnvironment();
+    backend_address = address;
+    backend_fd = fd;
+    backend_out.clear();
+    backend_out_offset = 0;
+    backend_in.clear();
+    backend_stdin_done = false;
+    backend_ended = false;
+    input_offset = 0;
+    output.clear();
+    header_state = HEADERS_PENDING;
+    body_left = std::string::npos;
+
+    const char begin[8] = { 0, FCGI_RESPONDER, FCGI_KEEP_CONN, 0, 0, 0, 0, 0 };
+    appendRecord(backend_out, FCGI_BEGIN_REQUEST, begin, sizeof(begin));
+    std::string params;
+    for (std::map<std::string, std::string>::const_iterator it = env_vars.begin(); it != env_vars.end(); ++it) {
+        appendParam(params, it->first, it->second);
+    }
+    for (size_t offset = 0; offset < params.size(); offset += FCGI_MAX_CONTENT) {
+        size_t length = std::min(params.size() - offset, static_cast<size_t>(FCGI_MAX_CONTENT));
+        appendRecord(backend_out, FCGI_PARAMS, params.data() + offset, length);
+    }
+    appendRecord(backend_out, FCGI_PARAMS, NULL, 0);
+}
+
+void CGI::appendRecord(std::string& out, unsigned char type, const char* data, size_t length) {
+    const char header[FCGI_HEADER_LEN] = {
+        FCGI_VERSION_1, static_cast<char>(type), 0, FCGI_REQUEST_ID,
+        static_cast<char>((length >> 8) & 0xff), static_cast<char>(length & 0xff), 0, 0
+    };
+    out.append(header, sizeof(header));
+    out.append(data, length);
+}
+
+// Name-value pair: lengths below 128 take one byte, longer ones four
+void CGI::appendParam(std::string& out, const std::string& name, const std::string& value) {
+    const std::string* parts[2] = { &name, &value };
+    for (int i = 0; i < 2; ++i) {
+        size_t length = parts[i]->length();
+        if (length < 128) {
+            out += static_cast<char>(length);
         } else {
-            char* argv[] = { (char*)script_path.c_str(), NULL };
-            execve(script_path.c_str(), argv, env);
+            out += static_cast<char>(((length >> 24) & 0x7f) | 0x80);
+            out += static_cast<char>((length >> 16) & 0xff);
+            out += static_cast<char>((length >> 8) & 0xff);
+            out += static_cast<char>(length & 0xff);
         }
+    }
+    out += name;
+    out += value;
+}
 
-        // If we get here, exec failed
-        freeEnvArray(env);
-        exit(1);
-    } else {
-        // Parent process
-        close(pipe_in[0]); // Close read end
-        close(pipe_out[1]); // Close write end
-        close(pipe_err[1]); // Close write end
-        
-        // Write request body to child
-        if (!request_body.empty()) {
-            ssize_t written = write(pipe_in[1], request_body.c_str(), request_body.length());
-            (void)written; // Suppress unused variable warning
+// Encodes the next window of the body received so far as FCGI_STDIN, then
+// the empty record that ends the stream. Returns false when nothing can be
+// queued: the stream has ended, or the rest of the body has not arrived yet.
+bool CGI::queueBackendInput() {
+    if (backend_stdin_done) {
+        return false;
+    }
+    const RequestBody& body = request->getBody();
+    if (input_offset < body.size()) {
+        char chunk[BUFFER_SIZE * 8];
+        ssize_t available = body.read(input_offset, chunk, sizeof(chunk));
+        if (available > 0) {
+            appendRecord(backend_out, FCGI_STDIN, chunk, available);
+            input_offset += available;
+            return true;
         }
-        close(pipe_in[1]);
-        
-        // Read response from child with timeout
-        std::string response;
-        char buffer[BUFFER_SIZE];
-        ssize_t bytes_read;
-        
-        // Set non-blocking I/O
-        fcntl(pipe_out[0], F_SETFL, O_NONBLOCK);
-        fcntl(pipe_err[0], F_SETFL, O_NONBLOCK);
-        
-        if (waitForChildWithTimeout(pid, CGI_TIMEOUT)) {
-            // Read stdout
-            while ((bytes_read = read(pipe_out[0], buffer, sizeof(buffer) - 1)) > 0) {
-                buffer[bytes_read] = '\0';
-                response.append(buffer, bytes_read);
+        // Spool file read failed: end the stream with what was sent
+    } else if (!request->isComplete()) {
+        return false;
+    }
+    appendRecord(backend_out, FCGI_STDIN, NULL, 0);
+    backend_stdin_done = true;
+    return true;
+}
+
+// Writes the queued records, refilling the queue from the body as the socket
+// drains. A connect() that did not succeed shows up here as INPUT_FAILED.
+CGI::InputState CGI::writeBackend() {
+    while (true) {
+        if (backend_out_offset == backend_out.size()) {
+            backend_out.clear();
+            backend_out_offset = 0;
+            if (!queueBackendInput()) {
+                return backend_stdin_done ? INPUT_DONE : INPUT_STARVED;
             }
-        } else {
-            // Timeout - kill the child process
-            kill(pid, SIGKILL);
-            waitpid(pid, NULL, 0);
-            close(pipe_out[0]);
-            close(pipe_err[0]);
-            std::string var;
-            var = "timeout";
-            return var;
-            // Create a response object for proper timeout handling
-            // Response timeout_response;
-            // timeout_response.sendGatewayTimeout("CGI script execution timed out after " + Utils::toString(CGI_TIMEOUT) + " seconds.");
-            // return timeout_response.buildResponse();
         }
-        
-        close(pipe_out[0]);
-        close(pipe_err[0]);
-        
-        // Parse CGI output to separate headers and body
-        if (!parseCGIOutput(response)) {
-            // Create a response object for proper error handling
-            Response error_response;
-            error_response.sendError(HTTP_INTERNAL_SERVER_ERROR, "Invalid CGI output format from script.");
-            return error_response.buildResponse();
+        ssize_t written = send(backend_fd, backend_out.data() + backend_out_offset,
+                               backend_out.size() - backend_out_offset, MSG_NOSIGNAL);
+        if (written == -1) {
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? INPUT_BLOCKED : INPUT_FAILED;
         }
-        
-        return response;
+        backend_out_offset += written;
     }
 }
 
+// Reads what the application sent and takes the complete records apart.
+// Returns the number of bytes read, 0 once the request ended or the connection
+// broke (hasBackendEnded() tells which) and -1 if no data is available yet.
+ssize_t CGI::readBackend() {
+    if (backend_ended) {
+        return 0;
+    }
+    char buffer[BUFFER_SIZE * 4];
+    ssize_t bytes_read = recv(backend_fd, buffer, sizeof(buffer), 0);
+    if (bytes_read > 0) {
+        backend_in.append(buffer, bytes_read);
+        if (!parseBackendRecords() || backend_ended) {
+            return 0;
+        }
+    } else if (bytes_read == -1 && errno != EAGAIN && errno != EWOULDBLOCK) {
+        bytes_read = 0;
+    }
+    return bytes_read;
+}
+
+// Collects FCGI_STDOUT into the output a script would have written, logs
+// FCGI_STDERR and stops at FCGI_END_REQUEST. Returns false on a malformed
+// stream or a request the application did not complete.
+bool CGI::parseBackendRecords() {
+    size_t offset = 0;
+    while (!backend_ended && backend_in.size() - offset >= FCGI_HEADER_LEN) {
+        const unsigned char* header = reinterpret_cast<const unsigned char*>(backend_in.data() + offset);
+        size_t content_length = (header[4] << 8) | header[5];
+        size_t record_length = FCGI_HEADER_LEN + content_length + header[6];
+        if (header[0] != FCGI_VERSION_1) {
+            return false;
+        }
+        if (backend_in.size() - offset < record_length) {
+            break;
+        }
+        const char* content = backend_in.data() + offset + FCGI_HEADER_LEN;
+        bool ours = ((header[2] << 8) | header[3]) == FCGI_REQUEST_ID;
+        if (ours && header[1] == FCGI_STDOUT) {
+            output.append(content, content_length);
+            splitHeaders(false);
+        } else if (ours && header[1] == FCGI_STDERR && LOG) {
+            std::cerr << "[FastCGI " << script_name << "] " << std::string(content, content_length);
+        } else if (ours && header[1] == FCGI_END_REQUEST) {
+            if (content_length < 8 || content[4] != FCGI_REQUEST_COMPLETE) {
+                return false;
+            }
+            backend_ended = true;
+        }
+        offset += record_length;
+    }
+    backend_in.erase(0, offset);
+    return true;
+}
+
+bool CGI::isWritingBackend() const {
+    return backend_fd != -1 && !(backend_stdin_done && backend_out_offset == backend_out.size());
+}
+
+bool CGI::hasBackendEnded() const {
+    return backend_ended;
+}
+
+// The application ended the request after reading all of it and sent nothing
+// more, so the connection can carry the next one
+bool CGI::isBackendReusable() const {
+    return backend_fd != -1 && backend_ended && backend_in.empty() && !isWritingBackend();
+}
+
+// Gives up the connection without closing it (it goes back to the pool)
+int CGI::detachBackend() {
+    int fd = backend_fd;
+    backend_fd = -1;
+    return fd;
+}
+
+void CGI::closeBackend() {
+    closeFd(backend_fd);
+}
+
+int CGI::getBackendFd() const {
+    return backend_fd;
+}
+
+const std::string& CGI::getBackendAddress() const {
+    return backend_address;
+}
+
 bool CGI::isValidScript(const std::string& path) {
     if (!Utils::fileExists(path)) {
         return false;
@@ -309,51 +743,29 @@ void CGI::setupStandardEnvironment() {
     env_vars["LD_LIBRARY_PATH"] = "";
 }
 
-bool CGI::waitForChildWithTimeout(pid_t pid, int timeout) {
-    int status;
-    time_t start_time = time(NULL);
-    
-    while (time(NULL) - start_time < timeout) {
-        pid_t result = waitpid(pid, &status, WNOHANG);
-        if (result == pid) {
-            // Child has finished
-            return true;
-        } else if (result == -1) {
-            // Error occurred
-            return false;
-        }
-        // Child is still running, sleep briefly
-        usleep(100000); // 100ms
+// Splits the header block off the output once the blank line ending it has
+// arrived. Output with no header block in its first CGI_OUTPUT_BUFFER_SIZE
+// bytes, or none at all by the end, is taken as body.
+void CGI::splitHeaders(bool at_end) {
+    if (header_state != HEADERS_PENDING) {
+        return;
+    }
+    size_t crlf_end = output.find("\r\n\r\n");
+    size_t lf_end = output.find("\n\n");
+    if (crlf_end != std::string::npos && (lf_end == std::string::npos || crlf_end < lf_end)) {
+        header_state = parseHeaderBlock(crlf_end, 4) ? HEADERS_READY : HEADERS_INVALID;
+    } else if (lf_end != std::string::npos) {
+        header_state = parseHeaderBlock(lf_end, 2) ? HEADERS_READY : HEADERS_INVALID;
+    } else if (at_end || output.size() >= CGI_OUTPUT_BUFFER_SIZE) {
+        cgi_headers = "Content-Type: text/html";
+        header_state = HEADERS_READY;
     }
-    
-    // Timeout occurred
-    return false;
 }
 
-bool CGI::parseCGIOutput(const std::string& output) {
-    cgi_headers.clear();
-    cgi_body.clear();
-    
-    // Find the double CRLF that separates headers from body
-    size_t header_end = output.find("\r\n\r\n");
-    if (header_end == std::string::npos) {
-        // Try with just LF
-        header_end = output.find("\n\n");
-        if (header_end == std::string::npos) {
-            // No header separation found - treat entire output as body
-            cgi_body = output;
-            // Add default content-type if missing
-            if (output.find("Content-Type:") == std::string::npos) {
-                cgi_headers = "Content-Type: text/html\r\n";
-            }
-            return true;
-        }
-        cgi_headers = output.substr(0, header_end);
-        cgi_body = output.substr(header_end + 2);
-    } else {
-        cgi_headers = output.substr(0, header_end);
-        cgi_body = output.substr(header_end + 4);
-    }
+// Takes the header block off the front of the output and checks it
+bool CGI::parseHeaderBlock(size_t header_end, size_t separator_length) {
+    cgi_headers = output.substr(0, header_end);
+    output.erase(0, header_end + separator_length);
     
     // Validate headers format
     std::istringstream header_stream(cgi_headers);
@@ -377,6 +789,8 @@ bool CGI::parseCGIOutput(const std::string& output) {
         std::string header_name = line.substr(0, colon_pos);
         if (header_name == "Content-Type") {
             has_content_type = true;
+        } else if (strcasecmp(header_name.c_str(), "Content-Length") == 0) {
+            body_left = strtoul(line.c_str() + colon_pos + 1, NULL, 10);
         }
     }
     
@@ -395,6 +809,25 @@ std::string CGI::getHeaders() const {
     return cgi_headers;
 }
 
-std::string CGI::getBody() const {
-    return cgi_body;
+CGI::HeaderState CGI::getHeaderState() const {
+    return header_state;
+}
+
+const std::string& CGI::getOutput() const {
+    return output;
+}
+
+// Hands over the body bytes read so far, cut at the script's Content-Length
+void CGI::takeOutput(std::string& body) {
+    body.clear();
+    body.swap(output);
+    if (body_left != std::string::npos) {
+        body.resize(std::min(body.size(), body_left));
+        body_left -= body.size();
+    }
+}
+
+// The script declared a Content-Length and ended before writing all of it
+bool CGI::isBodyShort() const {
+    return body_left != std::string::npos && body_left > 0;
 } 
\ No newline at end of file
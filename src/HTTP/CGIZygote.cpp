@@ -0,0 +1,240 @@
+#include "../../include/CGIZygote.hpp"
+#include "../../include/CGI.hpp"
+#include "../../include/default.hpp"
+#include <poll.h>
+#include <sys/syscall.h>
+
+CGIZygote::CGIZygote() : pid(-1) {
+}
+
+CGIZygote::~CGIZygote() {
+    stop();
+}
+
+// Forks the helper with one channel per worker. On failure the server keeps
+// spawning scripts itself.
+bool CGIZygote::start(size_t channel_count) {
+    std::vector<int> helper_ends;
+    for (size_t i = 0; i < channel_count; ++i) {
+        int pair[2];
+        if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, pair) == -1) {
+            break;
+        }
+        channels.push_back(pair[0]);
+        helper_ends.push_back(pair[1]);
+    }
+    if (helper_ends.size() == channel_count) {
+        pid = fork();
+    }
+    if (pid == 0) {
+        for (size_t i = 0; i < channels.size(); ++i) {
+            close(channels[i]);
+        }
+        serve(helper_ends);
+    }
+    for (size_t i = 0; i < helper_ends.size(); ++i) {
+        close(helper_ends[i]);
+    }
+    if (pid == -1) {
+        stop();
+        return false;
+    }
+    return true;
+}
+
+// Closing the channels is what tells the helper to exit
+void CGIZygote::stop() {
+    for (size_t i = 0; i < channels.size(); ++i) {
+        close(channels[i]);
+    }
+    channels.clear();
+    if (pid > 0) {
+        waitpid(pid, NULL, 0);
+        pid = -1;
+    }
+}
+
+int CGIZygote::getChannel(size_t index) const {
+    return index < channels.size() ? channels[index] : -1;
+}
+
+// Server side: asks the helper to run the script described by message,
+// without waiting for the answer. Returns false if the request could not be
+// queued on the channel.
+bool CGIZygote::request(int channel, const std::string& message) {
+    if (channel == -1 || message.size() > CGI_SPAWN_MESSAGE_MAX) {
+        return false;
+    }
+    return send(channel, message.data(), message.size(), MSG_NOSIGNAL | MSG_DONTWAIT) == static_cast<ssize_t>(message.size());
+}
+
+// Server side: takes the next answer off the channel once epoll reports it.
+// Returns 1 with the pid in child (-1 if the helper could not start the
+// script) and stdin, stdout, stderr and the child's pidfd in fds, 0 if no
+// answer is waiting, -1 once the helper is gone.
+int CGIZygote::receive(int channel, pid_t& child, int fds[4]) {
+    pid_t answer = -1;
+    struct iovec iov;
+    iov.iov_base = &answer;
+    iov.iov_len = sizeof(answer);
+    char control[CMSG_SPACE(4 * sizeof(int))];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t received = recvmsg(channel, &msg, MSG_CMSG_CLOEXEC | MSG_DONTWAIT);
+    if (received == -1 && (errno == EAGAIN || errno == EINTR)) {
+        return 0;
+    }
+    if (received <= 0) {
+        return -1;
+    }
+
+    int count = 0;
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+        count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        memcpy(fds, CMSG_DATA(cmsg), std::min(count, 4) * sizeof(int));
+    }
+    // Every answer is one request's, even a malformed one: it is consumed
+    child = -1;
+    if (received != sizeof(answer) || answer <= 0 || count != 4) {
+        for (int i = 0; i < std::min(count, 4); ++i) {
+            close(fds[i]);
+        }
+        return 1;
+    }
+    child = answer;
+    return 1;
+}
+
+// Sends signal to the child behind pidfd. A child that already exited (and
+// may have been reaped, its pid reused) is left alone.
+bool CGIZygote::kill(int pidfd, int signal) {
+    return syscall(SYS_pidfd_send_signal, pidfd, signal, NULL, 0) == 0;
+}
+
+// Helper side: answers spawn requests until every worker closed its channel
+void CGIZygote::serve(std::vector<int>& helper_channels) {
+    signal(SIGINT, SIG_IGN);    // the server shuts down by closing the channels
+    std::vector<char> buffer(CGI_SPAWN_MESSAGE_MAX);
+    std::vector<struct pollfd> watched(helper_channels.size());
+    for (size_t i = 0; i < helper_channels.size(); ++i) {
+        watched[i].fd = helper_channels[i];
+        watched[i].events = POLLIN;
+    }
+
+    size_t open_channels = watched.size();
+    while (open_channels > 0) {
+        // Exited children are collected here; until then their pid stays
+        // theirs, which is what lets spawnChild() open a pidfd for them
+        while (waitpid(-1, NULL, WNOHANG) > 0) {
+        }
+        int ready = poll(&watched[0], watched.size(), CGI_ZYGOTE_REAP_MS);
+        if (ready == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        for (size_t i = 0; i < watched.size(); ++i) {
+            if (watched[i].fd == -1 || !watched[i].revents) {
+                continue;
+            }
+            ssize_t length = recv(watched[i].fd, &buffer[0], buffer.size(), 0);
+            if (length > 0) {
+                spawnChild(watched[i].fd, &buffer[0], length);
+            } else if (length == 0 || errno != EINTR) {
+                close(watched[i].fd);
+                watched[i].fd = -1;
+                open_channels--;
+            }
+        }
+    }
+    _exit(0);
+}
+
+// A request is a list of NUL-terminated strings: the interpreter (empty to
+// run the script directly), the script, then the environment as NAME=value.
+// The environment is handed to exec straight from the message buffer.
+void CGIZygote::spawnChild(int channel, char* message, size_t length) {
+    // The last field must be terminated before strlen() walks any of them
+    if (message[length - 1] != '\0') {
+        reply(channel, -1, NULL, 0);
+        return;
+    }
+    std::vector<char*> fields;
+    for (size_t start = 0; start < length; start += strlen(message + start) + 1) {
+        fields.push_back(message + start);
+    }
+    if (fields.size() < 2) {
+        reply(channel, -1, NULL, 0);
+        return;
+    }
+    fields.push_back(NULL);
+
+    int pipe_in[2], pipe_out[2], pipe_err[2];
+    if (pipe2(pipe_in, O_CLOEXEC) == -1) {
+        reply(channel, -1, NULL, 0);
+        return;
+    }
+    if (pipe2(pipe_out, O_CLOEXEC) == -1) {
+        close(pipe_in[0]); close(pipe_in[1]);
+        reply(channel, -1, NULL, 0);
+        return;
+    }
+    if (pipe2(pipe_err, O_CLOEXEC) == -1) {
+        close(pipe_in[0]); close(pipe_in[1]);
+        close(pipe_out[0]); close(pipe_out[1]);
+        reply(channel, -1, NULL, 0);
+        return;
+    }
+
+    int child_fds[3] = { pipe_in[0], pipe_out[1], pipe_err[1] };
+    pid_t child = CGI::spawnProcess(fields[0], fields[1], &fields[2], child_fds);
+    close(pipe_in[0]);
+    close(pipe_out[1]);
+    close(pipe_err[1]);
+    int pidfd = child > 0 ? openPidfd(child) : -1;
+    if (child > 0 && pidfd == -1) {
+        ::kill(child, SIGKILL);
+        waitpid(child, NULL, 0);
+        child = -1;
+    }
+    int server_ends[4] = { pipe_in[1], pipe_out[0], pipe_err[0], pidfd };
+    reply(channel, child, server_ends, child > 0 ? 4 : 0);
+    for (int i = 0; i < 4; ++i) {
+        if (server_ends[i] != -1) {
+            close(server_ends[i]);
+        }
+    }
+}
+
+// The child is not reaped before the next poll round, so its pid cannot have
+// been reused yet
+int CGIZygote::openPidfd(pid_t child) {
+    return syscall(SYS_pidfd_open, child, 0);
+}
+
+void CGIZygote::reply(int channel, pid_t child, const int* fds, int count) {
+    struct iovec iov;
+    iov.iov_base = &child;
+    iov.iov_len = sizeof(child);
+    char control[CMSG_SPACE(4 * sizeof(int))];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (count > 0) {
+        msg.msg_control = control;
+        msg.msg_controllen = CMSG_SPACE(count * sizeof(int));
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(count * sizeof(int));
+        memcpy(CMSG_DATA(cmsg), fds, count * sizeof(int));
+    }
+    sendmsg(channel, &msg, MSG_NOSIGNAL);
+}
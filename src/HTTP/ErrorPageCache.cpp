@@ -0,0 +1,192 @@
+#include "../../include/ErrorPageCache.hpp"
+#include "../../include/Response.hpp"
+#include "../../include/TimerWheel.hpp"
+#include "../../include/Utils.hpp"
+
+// Every code the server answers with on its own. Each scope gets these and
+// its overrides; acquire() falls back to the 500 page for anything else.
+static const int precompiled_codes[] = {
+    HTTP_BAD_REQUEST, HTTP_FORBIDDEN, HTTP_NOT_FOUND, HTTP_METHOD_NOT_ALLOWED,
+    HTTP_REQUEST_ENTITY_TOO_LARGE, HTTP_RANGE_NOT_SATISFIABLE,
+    HTTP_INTERNAL_SERVER_ERROR, HTTP_BAD_GATEWAY, HTTP_GATEWAY_TIMEOUT
+};
+
+ErrorPageCache::ErrorPageCache() {
+    pthread_mutex_init(&lock, NULL);
+    pthread_mutex_init(&recheck_lock, NULL);
+}
+
+ErrorPageCache::~ErrorPageCache() {
+    for (PageMap::iterator it = pages.begin(); it != pages.end(); ++it) {
+        it->second.entry->release();
+    }
+    pthread_mutex_destroy(&lock);
+    pthread_mutex_destroy(&recheck_lock);
+}
+
+// Builds the pages of the server and of each of its locations. Called once
+// per server before the workers start.
+void ErrorPageCache::compile(const Server& server) {
+    std::vector<const Config*> server_scopes;
+    server_scopes.push_back(&server);
+    const std::map<std::string, Location>& locations = server.get_locations();
+    for (std::map<std::string, Location>::const_iterator it = locations.begin(); it != locations.end(); ++it) {
+        server_scopes.push_back(&it->second);
+    }
+
+    for (size_t i = 0; i < server_scopes.size(); ++i) {
+        const Config& scope = *server_scopes[i];
+        for (size_t j = 0; j < sizeof(precompiled_codes) / sizeof(precompiled_codes[0]); ++j) {
+            add(scope, precompiled_codes[j]);
+        }
+        const std::map<int, std::string>& overrides = scope.get_error_pages();
+        for (std::map<int, std::string>::const_iterator it = overrides.begin(); it != overrides.end(); ++it) {
+            add(scope, it->first);
+        }
+    }
+}
+
+// Finds the files the scope's page for code comes from, building the page
+// unless another scope already did
+void ErrorPageCache::add(const Config& scope, int code) {
+    const std::string& root = scope.get_root();
+    std::string override_path;
+    std::string template_path;
+    std::string error_page = scope.get_error_page(code);
+    if (!error_page.empty()) {
+        override_path = root + error_page;
+    }
+    int code_class = code / 100;
+    if (code_class >= 4 && code_class <= 6) {
+        template_path = root + "/" + Utils::toString(code_class) + "xx.html";
+    }
+
+    std::string key = override_path + "\n" + template_path + "\n" + Utils::toString(code);
+    PageMap::iterator it = pages.find(key);
+    if (it == pages.end()) {
+        it = pages.insert(std::make_pair(key, Page())).first;
+        Page& page = it->second;
+        if (!override_path.empty()) {
+            watch(page, override_path, false);
+        }
+        if (!template_path.empty()) {
+            watch(page, template_path, true);
+        }
+        page.code = code;
+        page.checked = TimerWheel::now();
+        page.entry = build(page);
+    }
+    scopes[&scope][code] = &it->second;
+}
+
+void ErrorPageCache::watch(Page& page, const std::string& path, bool is_template) {
+    Source source;
+    source.path = path;
+    source.is_template = is_template;
+    source.exists = false;
+    source.ino = 0;
+    source.size = 0;
+    source.mtime = 0;
+    page.sources.push_back(source);
+}
+
+bool ErrorPageCache::isCurrent(const Source& source) {
+    struct stat st;
+    if (stat(source.path.c_str(), &st) != 0) {
+        return !source.exists;
+    }
+    return source.exists && source.ino == st.st_ino
+        && source.size == st.st_size && source.mtime == st.st_mtime;
+}
+
+// Renders the page from the first source that can be read: the override as
+// is, the template with its placeholders filled in. Sources are stat()ed
+// first so a change made while reading shows up at the next check.
+StaticCache::Entry* ErrorPageCache::build(Page& page) {
+    std::string body;
+    std::string content_type = CONTENT_TYPE_HTML;
+    for (size_t i = 0; i < page.sources.size(); ++i) {
+        Source& source = page.sources[i];
+        struct stat st;
+        source.exists = (stat(source.path.c_str(), &st) == 0);
+        source.ino = source.exists ? st.st_ino : 0;
+        source.size = source.exists ? st.st_size : 0;
+        source.mtime = source.exists ? st.st_mtime : 0;
+        if (!body.empty() || !source.exists || !S_ISREG(st.st_mode)) {
+            continue;
+        }
+        std::string content = Utils::readFile(source.path);
+        if (content.empty()) {
+            continue;
+        }
+        if (source.is_template) {
+            body = Response::replacePlaceholders(content, page.code);
+        } else {
+            body = content;
+            content_type = Utils::getMimeType(source.path);
+        }
+    }
+    if (body.empty()) {
+        body = Response::generateErrorPage(page.code);
+    }
+
+    return StaticCache::Entry::create("Content-Type: " + content_type + "\r\n"
+        + "Content-Length: " + Utils::toString(body.size()) + "\r\n", body);
+}
+
+// Once per ERROR_PAGE_RECHECK_MS one worker claims the check and stat()s the
+// page's files; the others never wait for it and keep sending the current
+// version meanwhile
+void ErrorPageCache::recheck(Page& page) {
+    unsigned long now = TimerWheel::now();
+    unsigned long checked = page.checked;
+    if (now - checked < ERROR_PAGE_RECHECK_MS
+        || !__sync_bool_compare_and_swap(&page.checked, checked, now)) {
+        return;
+    }
+    if (pthread_mutex_trylock(&recheck_lock) != 0) {
+        return;
+    }
+    for (size_t i = 0; i < page.sources.size(); ++i) {
+        if (!isCurrent(page.sources[i])) {
+            StaticCache::Entry* fresh = build(page);
+            pthread_mutex_lock(&lock);
+            StaticCache::Entry* stale = page.entry;
+            page.entry = fresh;
+            pthread_mutex_unlock(&lock);
+            stale->release(); // responses still sending it hold their own reference
+            break;
+        }
+    }
+    pthread_mutex_unlock(&recheck_lock);
+}
+
+// The scope's page for code, retained for the caller, who releases it once
+// the response took its own reference
+StaticCache::Entry* ErrorPageCache::acquire(const Config& scope, int code) {
+    Page* page = NULL;
+    ScopeMap::const_iterator found = scopes.find(&scope);
+    if (found != scopes.end()) {
+        CodeMap::const_iterator it = found->second.find(code);
+        if (it == found->second.end()) {
+            it = found->second.find(HTTP_INTERNAL_SERVER_ERROR);
+        }
+        if (it != found->second.end()) {
+            page = it->second;
+        }
+    }
+    if (!page) {
+        page = &pages.begin()->second;
+    }
+
+    recheck(*page);
+    pthread_mutex_lock(&lock);
+    StaticCache::Entry* entry = page->entry;
+    entry->retain();
+    pthread_mutex_unlock(&lock);
+    return entry;
+}
+
+size_t ErrorPageCache::getCount() const {
+    return pages.size();
+}
@@ -0,0 +1,101 @@
+#include "../../include/FastCGIPool.hpp"
+#include "../../include/default.hpp"
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+FastCGIPool::FastCGIPool() : idle_count(0) {
+}
+
+FastCGIPool::~FastCGIPool() {
+    for (IdleMap::iterator it = idle.begin(); it != idle.end(); ++it) {
+        for (size_t i = 0; i < it->second.size(); ++i) {
+            close(it->second[i]);
+        }
+    }
+}
+
+// An idle connection to address, or a new one whose connect() may still be in
+// progress (the first write reports how it went). -1 if none can be opened.
+int FastCGIPool::acquire(const std::string& address) {
+    IdleMap::iterator it = idle.find(address);
+    if (it != idle.end()) {
+        while (!it->second.empty()) {
+            int fd = it->second.back();
+            it->second.pop_back();
+            idle_count--;
+            if (isAlive(fd)) {
+                return fd;
+            }
+            close(fd);
+        }
+    }
+    return connect(address);
+}
+
+// Keeps a connection whose last request ended cleanly for the next one
+void FastCGIPool::release(const std::string& address, int fd) {
+    std::vector<int>& connections = idle[address];
+    if (connections.size() >= FASTCGI_KEEPALIVE_DEFAULT) {
+        close(fd);
+        return;
+    }
+    connections.push_back(fd);
+    idle_count++;
+}
+
+size_t FastCGIPool::getIdleCount() const {
+    return idle_count;
+}
+
+// An idle connection has nothing to read: EOF or stray bytes mean the backend
+// closed it or is out of step with us
+bool FastCGIPool::isAlive(int fd) {
+    char byte;
+    ssize_t peeked = recv(fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+    return peeked == -1 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+// Starts a non-blocking connect to "unix:/path" or "ip:port", the forms the
+// fastcgi_pass directive stores
+int FastCGIPool::connect(const std::string& address) {
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+    memset(&addr, 0, sizeof(addr));
+    if (address.compare(0, 5, "unix:") == 0) {
+        struct sockaddr_un* un = reinterpret_cast<struct sockaddr_un*>(&addr);
+        std::string path = address.substr(5);
+        if (path.length() >= sizeof(un->sun_path)) {
+            return -1;
+        }
+        un->sun_family = AF_UNIX;
+        memcpy(un->sun_path, path.c_str(), path.length() + 1);
+        addr_len = sizeof(*un);
+    } else {
+        struct sockaddr_in* in = reinterpret_cast<struct sockaddr_in*>(&addr);
+        size_t colon = address.rfind(':');
+        if (colon == std::string::npos
+            || inet_pton(AF_INET, address.substr(0, colon).c_str(), &in->sin_addr) != 1) {
+            return -1;
+        }
+        in->sin_family = AF_INET;
+        in->sin_port = htons(static_cast<unsigned short>(atoi(address.c_str() + colon + 1)));
+        addr_len = sizeof(*in);
+    }
+
+    int fd = socket(addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return -1;
+    }
+    if (::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), addr_len) == -1 && errno != EINPROGRESS) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
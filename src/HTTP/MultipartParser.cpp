@@ -0,0 +1,243 @@
+#include "../../include/MultipartParser.hpp"
+#include "../../include/Utils.hpp"
+#include "../../include/Request.hpp"
+
+#define MAX_BOUNDARY_LENGTH 70 // RFC 2046
+
+MultipartParser::MultipartParser()
+    : state(INACTIVE), max_file_size(0), file_fd(-1), error_code(0) {
+    current.size = 0;
+}
+
+MultipartParser::~MultipartParser() {
+    closeFile(false);
+}
+
+// Starts a new body. Returns false if content_type carries no usable boundary.
+bool MultipartParser::begin(const std::string& content_type, const std::string& store, size_t max_size) {
+    reset();
+    size_t boundary_pos = Utils::toLower(content_type).find("boundary=");
+    if (boundary_pos == std::string::npos)
+        return false;
+    std::string boundary = content_type.substr(boundary_pos + 9);
+    boundary = Utils::trim(boundary.substr(0, boundary.find(';')));
+    if (boundary.length() >= 2 && boundary[0] == '"' && boundary[boundary.length() - 1] == '"')
+        boundary = boundary.substr(1, boundary.length() - 2);
+    if (boundary.empty() || boundary.length() > MAX_BOUNDARY_LENGTH)
+        return false;
+
+    delimiter = "\r\n--" + boundary;
+    for (size_t i = 0; i < 256; ++i)
+        skip[i] = delimiter.length();
+    for (size_t i = 0; i + 1 < delimiter.length(); ++i)
+        skip[static_cast<unsigned char>(delimiter[i])] = delimiter.length() - 1 - i;
+
+    store_path = store;
+    max_file_size = max_size;
+    // The first boundary may open the body: pretend a line break precedes it
+    window = "\r\n";
+    state = PREAMBLE;
+    return true;
+}
+
+// Boyer-Moore-Horspool search for the delimiter in window, starting at from
+size_t MultipartParser::findDelimiter(size_t from) const {
+    size_t length = delimiter.length();
+    size_t pos = from;
+    while (pos + length <= window.length()) {
+        size_t i = length - 1;
+        while (window[pos + i] == delimiter[i]) {
+            if (i == 0)
+                return pos;
+            --i;
+        }
+        pos += skip[static_cast<unsigned char>(window[pos + length - 1])];
+    }
+    return std::string::npos;
+}
+
+void MultipartParser::feed(const char* data, size_t size) {
+    if (state == INACTIVE || state == DONE || state == FAILED)
+        return;
+    window.append(data, size);
+
+    size_t pos = 0;
+    bool need_more = false;
+    while (!need_more && state != DONE && state != FAILED) {
+        if (state == PREAMBLE || state == DATA) {
+            size_t found = findDelimiter(pos);
+            if (found == std::string::npos) {
+                // Everything but a possible delimiter prefix is part content
+                size_t keep = delimiter.length() - 1;
+                if (window.length() - pos > keep) {
+                    size_t flush_end = window.length() - keep;
+                    if (state == DATA && !writeData(window.data() + pos, flush_end - pos))
+                        return;
+                    pos = flush_end;
+                }
+                need_more = true;
+                continue;
+            }
+            if (state == DATA) {
+                if (!writeData(window.data() + pos, found - pos))
+                    return;
+                closeFile(true);
+            }
+            pos = found + delimiter.length();
+            state = DELIMITER_END;
+        } else if (state == DELIMITER_END) {
+            // "--" closes the body, otherwise the line ends and a part follows
+            if (window.length() - pos < 2) {
+                need_more = true;
+                continue;
+            }
+            if (window.compare(pos, 2, "--") == 0) {
+                state = DONE;
+                break;
+            }
+            size_t line_end = window.find("\r\n", pos);
+            if (line_end == std::string::npos) {
+                if (window.length() - pos > MAX_HEADER_SIZE)
+                    fail(HTTP_BAD_REQUEST, "Invalid multipart data");
+                need_more = true;
+                continue;
+            }
+            pos = line_end + 2;
+            state = HEADERS;
+        } else if (state == HEADERS) {
+            size_t headers_end;
+            size_t data_start;
+            if (window.compare(pos, 2, "\r\n") == 0) {
+                headers_end = pos; // Part without headers
+                data_start = pos + 2;
+            } else {
+                headers_end = window.find("\r\n\r\n", pos);
+                data_start = headers_end + 4;
+            }
+            if (headers_end == std::string::npos) {
+                if (window.length() - pos > MAX_HEADER_SIZE)
+                    fail(HTTP_BAD_REQUEST, "Invalid multipart headers");
+                need_more = true;
+                continue;
+            }
+            if (!startPart(window.substr(pos, headers_end - pos)))
+                return;
+            pos = data_start;
+            // The part's data starts where the previous delimiter search left off
+            window.erase(0, pos);
+            pos = 0;
+            state = DATA;
+        }
+    }
+    if (state == DONE || state == FAILED)
+        std::string().swap(window);
+    else
+        window.erase(0, pos);
+}
+
+// Opens the destination of a file part; other form fields are skipped
+bool MultipartParser::startPart(const std::string& headers) {
+    std::string filename;
+    std::istringstream header_stream(headers);
+    std::string line;
+    while (std::getline(header_stream, line)) {
+        if (Utils::toLower(line).find("content-disposition:") != 0)
+            continue;
+        size_t filename_pos = line.find("filename=\"");
+        if (filename_pos != std::string::npos) {
+            filename_pos += 10; // length of "filename=\""
+            size_t filename_end = line.find("\"", filename_pos);
+            if (filename_end != std::string::npos)
+                filename = line.substr(filename_pos, filename_end - filename_pos);
+        }
+    }
+    if (filename.empty())
+        return true;
+
+    // Security: validate filename
+    if (filename.find("..") != std::string::npos || filename.find("/") != std::string::npos) {
+        fail(HTTP_BAD_REQUEST, "Invalid filename");
+        return false;
+    }
+    file_path = store_path + "/" + filename;
+    file_fd = open(file_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (file_fd == -1) {
+        fail(HTTP_INTERNAL_SERVER_ERROR, "Failed to create upload file");
+        return false;
+    }
+    current.name = filename;
+    current.size = 0;
+    return true;
+}
+
+bool MultipartParser::writeData(const char* data, size_t size) {
+    if (file_fd == -1 || size == 0)
+        return true;
+    if (current.size + size > max_file_size) {
+        fail(HTTP_REQUEST_ENTITY_TOO_LARGE, "File size exceeds configured limit");
+        return false;
+    }
+    size_t written = 0;
+    while (written < size) {
+        ssize_t result = write(file_fd, data + written, size - written);
+        if (result <= 0) {
+            fail(HTTP_INTERNAL_SERVER_ERROR, "Failed to write upload file");
+            return false;
+        }
+        written += result;
+    }
+    current.size += size;
+    return true;
+}
+
+// Finishes the current file part; unfinished files are removed
+void MultipartParser::closeFile(bool keep) {
+    if (file_fd == -1)
+        return;
+    close(file_fd);
+    file_fd = -1;
+    if (keep)
+        files.push_back(current);
+    else
+        unlink(file_path.c_str());
+}
+
+void MultipartParser::fail(int code, const std::string& message) {
+    closeFile(false);
+    state = FAILED;
+    error_code = code;
+    error_message = message;
+}
+
+void MultipartParser::reset() {
+    closeFile(false);
+    state = INACTIVE;
+    std::string().swap(window);
+    files.clear();
+    error_code = 0;
+    error_message.clear();
+}
+
+bool MultipartParser::isActive() const {
+    return state != INACTIVE;
+}
+
+bool MultipartParser::isComplete() const {
+    return state == DONE;
+}
+
+bool MultipartParser::hasFailed() const {
+    return state == FAILED;
+}
+
+int MultipartParser::getErrorCode() const {
+    return error_code;
+}
+
+const std::string& MultipartParser::getErrorMessage() const {
+    return error_message;
+}
+
+const std::vector<MultipartParser::SavedFile>& MultipartParser::getFiles() const {
+    return files;
+}
@@ -0,0 +1,131 @@
+#include "../../include/OpenFileCache.hpp"
+#include "../../include/TimerWheel.hpp"
+
+bool OpenFileCache::File::isDirectory() const {
+    return exists && S_ISDIR(st.st_mode);
+}
+
+OpenFileCache::OpenFileCache() : max_entries(0), inactive_ms(0) {
+    uncached.exists = false;
+    uncached.readable = false;
+    uncached.fd = -1;
+}
+
+OpenFileCache::~OpenFileCache() {
+    while (!entries.empty())
+        evict(entries.begin());
+    release(uncached);
+}
+
+void OpenFileCache::configure(size_t new_max_entries, int inactive_seconds) {
+    max_entries = new_max_entries;
+    inactive_ms = static_cast<unsigned long>(inactive_seconds) * 1000;
+    while (entries.size() > max_entries)
+        evict(entries.find(lru.back()));
+}
+
+bool OpenFileCache::isEnabled() const {
+    return max_entries > 0;
+}
+
+// One open() answers existence and readability and yields the descriptor;
+// stat() is only needed when the path exists but cannot be opened
+void OpenFileCache::load(const std::string& path, File& file) {
+    file.fd = open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+    if (file.fd != -1) {
+        file.exists = true;
+        file.readable = true;
+        if (fstat(file.fd, &file.st) == -1) {
+            file.exists = false;
+            file.readable = false;
+        }
+        if (!file.exists || !S_ISREG(file.st.st_mode)) {
+            close(file.fd);
+            file.fd = -1;
+        }
+        return;
+    }
+    file.readable = false;
+    file.exists = (stat(path.c_str(), &file.st) == 0);
+}
+
+void OpenFileCache::release(File& file) {
+    if (file.fd != -1) {
+        close(file.fd);
+        file.fd = -1;
+    }
+}
+
+// Same inode, same size, same mtime: the cached answer still holds
+bool OpenFileCache::isSameFile(const File& file, const struct stat& st) {
+    return file.st.st_ino == st.st_ino && file.st.st_dev == st.st_dev
+        && file.st.st_size == st.st_size && file.st.st_mtime == st.st_mtime
+        && file.st.st_mode == st.st_mode;
+}
+
+void OpenFileCache::evict(EntryMap::iterator it) {
+    release(it->second.file);
+    lru.erase(it->second.lru);
+    entries.erase(it);
+}
+
+// The result, including its descriptor, stays valid until the next lookup
+const OpenFileCache::File& OpenFileCache::lookup(const std::string& path, int valid_seconds) {
+    if (!isEnabled())
+        return lookupUncached(path);
+
+    unsigned long now = TimerWheel::now();
+    EntryMap::iterator it = entries.find(path);
+    if (it != entries.end()) {
+        Entry& entry = it->second;
+        lru.splice(lru.begin(), lru, entry.lru);
+        entry.last_used = now;
+        if (now - entry.validated < static_cast<unsigned long>(valid_seconds) * 1000)
+            return entry.file;
+        struct stat st;
+        if (stat(path.c_str(), &st) == 0 && isSameFile(entry.file, st)) {
+            entry.validated = now;
+            return entry.file;
+        }
+        evict(it);
+    }
+
+    // Missing paths are not cached, so new files show up right away
+    const File& file = lookupUncached(path);
+    if (!file.exists)
+        return file;
+    if (entries.size() >= max_entries)
+        evict(entries.find(lru.back()));
+    lru.push_front(path);
+    Entry& entry = entries[path];
+    entry.lru = lru.begin();
+    entry.validated = now;
+    entry.last_used = now;
+    entry.file = uncached;
+    uncached.fd = -1; // Now owned by the entry
+    return entry.file;
+}
+
+// Bypasses the cache; the result is valid until the next call
+const OpenFileCache::File& OpenFileCache::lookupUncached(const std::string& path) {
+    release(uncached);
+    load(path, uncached);
+    return uncached;
+}
+
+// Forgets path after this loop changed it (DELETE)
+void OpenFileCache::invalidate(const std::string& path) {
+    EntryMap::iterator it = entries.find(path);
+    if (it != entries.end())
+        evict(it);
+}
+
+// Drops entries unused for longer than the inactive period
+void OpenFileCache::expire(unsigned long now_ms) {
+    while (!lru.empty()) {
+        EntryMap::iterator it = entries.find(lru.back());
+        if (now_ms - it->second.last_used < inactive_ms)
+            break;
+        evict(it);
+    }
+}
@@ -1,18 +1,21 @@
 #include "../../include/Request.hpp"
 #include "../../include/Utils.hpp"
+#include "../../include/MultipartParser.hpp"
 
 Request::Request() : 
     method(""),
     uri(""),
     version(""),
+    body_parser(NULL),
+    body_length(0),
     is_chunked(false),
     content_length(0),
     is_complete(false),
-    expected_chunk_size(0),
-    reading_chunk_size(true),
+    chunk_pos(0),
+    chunk_remaining(0),
+    chunk_state(CHUNK_SIZE),
     headers_parsed(false),
-    waiting_final_crlf(false),
-    reading_trailing_headers(false),
+    body_started(false),
     max_body_size(0) {
 }
 
@@ -20,7 +23,17 @@ Request::~Request() {
 }
 
 void Request::parse(const std::string& raw_request) {
-    buffer += raw_request;
+    parse(raw_request.data(), raw_request.size());
+}
+
+void Request::parse(const char* data, size_t length) {
+    // Content-Length bodies go straight from the read into the body
+    if (body_started && !is_chunked && !is_complete) {
+        size_t used = appendBody(data, length);
+        data += used;
+        length -= used;
+    }
+    buffer.append(data, length);
     
     if (is_complete) {
         return;
@@ -40,7 +53,6 @@ void Request::parse(const std::string& raw_request) {
         }
         
         std::string headers_part = buffer.substr(0, pos);
-        std::string body_part = buffer.substr(pos + 4);
         
         // Parse headers
         std::istringstream header_stream(headers_part);
@@ -62,26 +74,81 @@ void Request::parse(const std::string& raw_request) {
         headers_parsed = true;
         
         // Remove processed headers from buffer
-        buffer = body_part;
+        buffer.erase(0, pos + 4);
+        // The caller picks the body limits and destination, then calls beginBody()
+        return;
     }
     
-    // Handle body
+    if (body_started) {
+        parseBody();
+    }
+}
+
+// Starts on the body once the headers are parsed and the body is configured;
+// whatever arrived with the headers is its first part
+void Request::beginBody() {
+    if (is_complete || body_started) {
+        return;
+    }
+    body_started = true;
+    if (max_body_size > 0 && content_length > max_body_size) {
+        is_complete = true;
+        method = "ERROR_REQUEST_ENTITY_TOO_LARGE";
+        return;
+    }
+    if (!is_chunked && content_length > 0) {
+        // One allocation for the whole body unless it is streamed elsewhere
+        if (!body_parser) {
+            body.reserve(std::min(content_length, static_cast<size_t>(MAX_BODY_SIZE)));
+        }
+        size_t used = appendBody(buffer.data(), buffer.size());
+        buffer.erase(0, used); // Keep pipelined bytes for the next request
+    }
+    parseBody();
+}
+
+void Request::parseBody() {
+    if (is_complete) {
+        return;
+    }
     if (is_chunked) {
-        parseChunkedBody(buffer);
-        buffer.clear(); // Clear buffer after processing chunked data
-    } else {
-        body = buffer;
-        if (content_length > 0 && body.length() >= content_length) {
-            body = body.substr(0, content_length);
-            is_complete = true;
-        } else if (content_length == 0) {
-            is_complete = true;
+        parseChunkedBody();
+        if (is_complete) {
+            buffer.erase(0, chunk_pos); // Bytes after the last chunk belong to the next request
+            chunk_pos = 0;
         }
+    } else if (body_length == content_length) {
+        is_complete = true;
     }
 }
 
-void Request::appendData(const std::string& data) {
-    parse(data);
+// Copies up to the rest of a Content-Length body; returns the bytes used
+size_t Request::appendBody(const char* data, size_t length) {
+    size_t used = std::min(length, content_length - body_length);
+    if (!storeBody(data, used)) {
+        return length;
+    }
+    if (body_length == content_length) {
+        is_complete = true;
+    }
+    return used;
+}
+
+// Hands body bytes to the body parser if one is set, otherwise stores them
+bool Request::storeBody(const char* data, size_t length) {
+    if (body_parser) {
+        body_parser->feed(data, length);
+    } else if (!body.append(data, length)) {
+        is_complete = true;
+        method = "ERROR_BODY_STORAGE";
+        return false;
+    }
+    body_length += length;
+    return true;
+}
+
+void Request::appendData(const char* data, size_t length) {
+    parse(data, length);
 }
 
 void Request::parseRequestLine(const std::string& line) {
@@ -116,12 +183,6 @@ void Request::parseHeader(const std::string& line) {
         // Handle special headers
         if (Utils::toLower(name) == "content-length") {
             content_length = std::atoi(value.c_str());
-            // Check content-length against max body size limit immediately
-            if (max_body_size > 0 && content_length > max_body_size) {
-                is_complete = true;
-                method = "ERROR_REQUEST_ENTITY_TOO_LARGE";
-                return;
-            }
         } else if (Utils::toLower(name) == "transfer-encoding" && 
                    Utils::toLower(value) == "chunked") {
             is_chunked = true;
@@ -129,150 +190,172 @@ void Request::parseHeader(const std::string& line) {
     }
 }
 
-void Request::parseChunkedBody(const std::string& data) {
-    chunk_buffer += data;
+// Decodes as much of the chunked body in buffer as is available. A cursor walks
+// the buffer and chunk data is appended to the body as soon as it arrives, so
+// every byte is copied once; consumed bytes are dropped only when they make up
+// most of the buffer.
+void Request::parseChunkedBody() {
+    size_t max_size = (max_body_size > 0) ? max_body_size : MAX_BODY_SIZE;
     
-    while (!chunk_buffer.empty() && !is_complete) {
-        if (reading_trailing_headers) {
-            // Parse trailing headers after final chunk
-            size_t crlf_pos = chunk_buffer.find("\r\n");
-            if (crlf_pos == std::string::npos) {
-                return; // Need more data
-            }
-            
-            std::string header_line = chunk_buffer.substr(0, crlf_pos);
-            chunk_buffer = chunk_buffer.substr(crlf_pos + 2);
-            
-            if (header_line.empty()) {
-                // Empty line indicates end of trailing headers
-                is_complete = true;
+    while (!is_complete && chunk_pos < buffer.size()) {
+        if (chunk_state == CHUNK_DATA) {
+            size_t available = std::min(buffer.size() - chunk_pos, chunk_remaining);
+            if (!storeBody(buffer.data() + chunk_pos, available)) {
                 return;
             }
-            
-            // Parse trailing header
-            size_t colon_pos = header_line.find(':');
-            if (colon_pos != std::string::npos) {
-                std::string name = Utils::trim(header_line.substr(0, colon_pos));
-                std::string value = Utils::trim(header_line.substr(colon_pos + 1));
-                trailing_headers[Utils::toLower(name)] = value;
-            }
-            
-        } else if (waiting_final_crlf) {
-            // After zero chunk, check for trailing headers or final CRLF
-            size_t crlf_pos = chunk_buffer.find("\r\n");
-            if (crlf_pos == std::string::npos) {
-                return; // Need more data
-            }
-            
-            std::string line = chunk_buffer.substr(0, crlf_pos);
-            
-            if (line.empty()) {
-                // Empty line = no trailing headers, complete
+            chunk_pos += available;
+            chunk_remaining -= available;
+            if (chunk_remaining == 0)
+                chunk_state = CHUNK_DATA_CRLF;
+            continue;
+        }
+        
+        if (chunk_state == CHUNK_DATA_CRLF) {
+            if (buffer.size() - chunk_pos < 2)
+                break; // Need more data
+            if (buffer[chunk_pos] != '\r' || buffer[chunk_pos + 1] != '\n') {
                 is_complete = true;
-                return;
-            } else {
-                // Has trailing headers
-                reading_trailing_headers = true;
-                waiting_final_crlf = false;
-                continue; // Process the header line
-            }
-            
-        } else if (reading_chunk_size) {
-            // Look for CRLF to find end of chunk size line
-            size_t crlf_pos = chunk_buffer.find("\r\n");
-            if (crlf_pos == std::string::npos) {
-                return; // Need more data
-            }
-            
-            std::string size_line = chunk_buffer.substr(0, crlf_pos);
-            chunk_buffer = chunk_buffer.substr(crlf_pos + 2);
-            
-            // Parse chunk size, handling extensions
-            std::string hex_size = parseChunkSize(size_line);
-            
-            // Parse hex chunk size
-            std::stringstream ss;
-            ss << std::hex << hex_size;
-            ss >> expected_chunk_size;
-            
-            // Check for parsing failure
-            if (ss.fail()) {
-                expected_chunk_size = 0;
-            }
-            
-            // Check size limits
-            if (expected_chunk_size > MAX_CHUNK_SIZE) {
-                // Chunk too large, reject
-                is_complete = true; // Mark as complete but body will be truncated
+                method = "ERROR_BAD_REQUEST";
                 return;
             }
-            
-            // Check total body size limit
-            size_t max_size = (max_body_size > 0) ? max_body_size : MAX_BODY_SIZE;
-            if (body.length() + expected_chunk_size > max_size) {
-                // Total body too large, reject
+            chunk_pos += 2;
+            chunk_state = CHUNK_SIZE;
+            continue;
+        }
+        
+        // Size lines and trailer lines end with CRLF
+        size_t crlf_pos = buffer.find("\r\n", chunk_pos);
+        if (crlf_pos == std::string::npos) {
+            if (buffer.size() - chunk_pos > MAX_HEADER_SIZE) {
                 is_complete = true;
-                method = "ERROR_REQUEST_ENTITY_TOO_LARGE";
+                method = "ERROR_BAD_REQUEST";
                 return;
             }
-            
-            // Check for final chunk (size 0)
-            if (expected_chunk_size == 0) {
-                waiting_final_crlf = true;
-                reading_chunk_size = false;
-                continue;
+            break; // Need more data
+        }
+        const char* line = buffer.data() + chunk_pos;
+        size_t line_length = crlf_pos - chunk_pos;
+        chunk_pos = crlf_pos + 2;
+        
+        if (chunk_state == CHUNK_TRAILER) {
+            if (line_length == 0) {
+                // Empty line ends the trailing headers and the body
+                is_complete = true;
+                break;
             }
-            
-            reading_chunk_size = false;
-            
-        } else {
-            // Reading chunk data
-            size_t needed = expected_chunk_size + 2; // +2 for trailing CRLF
-            if (chunk_buffer.length() < needed) {
-                return; // Need more data
+            std::string header_line(line, line_length);
+            size_t colon_pos = header_line.find(':');
+            if (colon_pos != std::string::npos) {
+                std::string name = Utils::trim(header_line.substr(0, colon_pos));
+                std::string value = Utils::trim(header_line.substr(colon_pos + 1));
+                trailing_headers[Utils::toLower(name)] = value;
             }
-            
-            // Extract chunk data (excluding trailing CRLF)
-            std::string chunk_data = chunk_buffer.substr(0, expected_chunk_size);
-            body += chunk_data;
-            
-            // Remove processed chunk data and trailing CRLF
-            chunk_buffer = chunk_buffer.substr(needed);
-            
-            // Reset for next chunk
-            reading_chunk_size = true;
-            expected_chunk_size = 0;
+            continue;
+        }
+        
+        size_t chunk_size;
+        if (!parseChunkSize(line, line_length, chunk_size)) {
+            is_complete = true;
+            method = "ERROR_BAD_REQUEST";
+            return;
         }
+        if (chunk_size > MAX_CHUNK_SIZE || body_length + chunk_size > max_size) {
+            is_complete = true;
+            method = "ERROR_REQUEST_ENTITY_TOO_LARGE";
+            return;
+        }
+        if (chunk_size == 0) {
+            // Last chunk: optional trailing headers follow, then an empty line
+            chunk_state = CHUNK_TRAILER;
+            continue;
+        }
+        chunk_remaining = chunk_size;
+        chunk_state = CHUNK_DATA;
+    }
+    
+    if (is_complete)
+        return;
+    if (chunk_pos == buffer.size()) {
+        buffer.clear();
+        chunk_pos = 0;
+    } else if (chunk_pos > buffer.size() / 2) {
+        buffer.erase(0, chunk_pos);
+        chunk_pos = 0;
     }
 }
 
-std::string Request::parseChunkSize(const std::string& size_line) {
-    // Parse chunk size, handling extensions (RFC 7230)
-    // Format: chunk-size [ chunk-ext ] CRLF
-    // chunk-ext = *( ";" chunk-ext-name [ "=" chunk-ext-val ] )
-    
-    std::string hex_size;
-    size_t semicolon_pos = size_line.find(';');
-    
-    if (semicolon_pos != std::string::npos) {
-        // Has extensions, extract just the size part
-        hex_size = Utils::trim(size_line.substr(0, semicolon_pos));
-    } else {
-        // No extensions
-        hex_size = Utils::trim(size_line);
+// Parses "chunk-size [ chunk-ext ]" (RFC 7230); extensions are ignored
+bool Request::parseChunkSize(const char* line, size_t length, size_t& size) {
+    size_t i = 0;
+    while (i < length && (line[i] == ' ' || line[i] == '\t'))
+        i++;
+    size_t digits = 0;
+    size = 0;
+    for (; i < length; ++i, ++digits) {
+        char c = line[i];
+        int value;
+        if (c >= '0' && c <= '9')
+            value = c - '0';
+        else if (c >= 'a' && c <= 'f')
+            value = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            value = c - 'A' + 10;
+        else
+            break;
+        size = (size << 4) | value;
+        if (size > MAX_CHUNK_SIZE)
+            size = MAX_CHUNK_SIZE + 1; // Saturate; the caller rejects it
     }
-    
-    return hex_size;
+    if (digits == 0)
+        return false;
+    while (i < length && (line[i] == ' ' || line[i] == '\t'))
+        i++;
+    return i == length || line[i] == ';';
 }
 
 std::string Request::urlDecode(const std::string& str) {
     return Utils::urlDecode(str);
 }
 
+bool Request::hasHeaders() const {
+    return headers_parsed;
+}
+
+// Headers are in but beginBody() has not been called yet
+bool Request::isAwaitingBody() const {
+    return headers_parsed && !body_started && !is_complete;
+}
+
 bool Request::isComplete() const {
     return is_complete;
 }
 
+// HTTP/1.1 connections persist unless the client asks to close them,
+// HTTP/1.0 ones only when the client explicitly asks for keep-alive
+bool Request::isKeepAlive() const {
+    std::string connection = Utils::toLower(getHeader("Connection"));
+    if (version == "HTTP/1.1") {
+        return connection.find("close") == std::string::npos;
+    }
+    if (version == "HTTP/1.0") {
+        return connection.find("keep-alive") != std::string::npos;
+    }
+    return false;
+}
+
+// Hands over bytes received after the end of this request (pipelining)
+std::string Request::takePipelinedData() {
+    std::string pipelined;
+    if (is_complete) {
+        pipelined.swap(buffer);
+    }
+    return pipelined;
+}
+
+bool Request::hasData() const {
+    return headers_parsed || !buffer.empty();
+}
+
 bool Request::hasError() const {
     return method.find("ERROR_") == 0;
 }
@@ -289,19 +372,20 @@ void Request::reset() {
     uri.clear();
     version.clear();
     headers.clear();
-    body.clear();
+    body.clear(); // Frees the memory or spool file of a large upload
+    body_parser = NULL;
+    body_length = 0;
     query_string.clear();
     path_info.clear();
     is_chunked = false;
     content_length = 0;
     is_complete = false;
     buffer.clear();
-    chunk_buffer.clear();
-    expected_chunk_size = 0;
-    reading_chunk_size = true;
+    chunk_pos = 0;
+    chunk_remaining = 0;
+    chunk_state = CHUNK_SIZE;
     headers_parsed = false;
-    waiting_final_crlf = false;
-    reading_trailing_headers = false;
+    body_started = false;
     trailing_headers.clear();
     max_body_size = 0;
 }
@@ -310,12 +394,22 @@ void Request::setMaxBodySize(size_t max_size) {
     max_body_size = max_size;
 }
 
+// Bodies larger than buffer_size are spooled to a temporary file in temp_path
+void Request::setBodyBuffer(size_t buffer_size, const std::string& temp_path) {
+    body.configure(buffer_size, temp_path);
+}
+
+// Streams the body into parser instead of keeping it; set before beginBody()
+void Request::setBodyParser(MultipartParser* parser) {
+    body_parser = parser;
+}
+
 // Getters
 const std::string& Request::getMethod() const { return method; }
 const std::string& Request::getUri() const { return uri; }
 const std::string& Request::getVersion() const { return version; }
 const std::map<std::string, std::string>& Request::getHeaders() const { return headers; }
-const std::string& Request::getBody() const { return body; }
+const RequestBody& Request::getBody() const { return body; }
 const std::string& Request::getQueryString() const { return query_string; }
 const std::string& Request::getPathInfo() const { return path_info; }
 size_t Request::getContentLength() const { return content_length; }
@@ -340,6 +434,6 @@ void Request::print() const {
          it != headers.end(); ++it) {
         std::cout << "  " << it->first << ": " << it->second << std::endl;
     }
-    std::cout << "Body length: " << body.length() << std::endl;
+    std::cout << "Body length: " << body.size() << std::endl;
     std::cout << "Complete: " << (is_complete ? "yes" : "no") << std::endl;
 } 
\ No newline at end of file
@@ -0,0 +1,176 @@
+#include "../../include/RequestBody.hpp"
+#include "../../include/default.hpp"
+
+#define SPOOL_IO_SIZE (64 * 1024)
+
+RequestBody::RequestBody()
+    : fd(-1), length(0),
+      buffer_size(CLIENT_BODY_BUFFER_SIZE_DEFAULT),
+      temp_path(CLIENT_BODY_TEMP_PATH_DEFAULT) {
+}
+
+// Copies share the spool file through their own descriptor
+RequestBody::RequestBody(const RequestBody& other)
+    : memory(other.memory), fd(-1), length(other.length),
+      buffer_size(other.buffer_size), temp_path(other.temp_path) {
+    if (other.fd != -1)
+        fd = fcntl(other.fd, F_DUPFD_CLOEXEC, 0);
+}
+
+RequestBody& RequestBody::operator=(const RequestBody& other) {
+    if (this != &other) {
+        closeFile();
+        memory = other.memory;
+        length = other.length;
+        buffer_size = other.buffer_size;
+        temp_path = other.temp_path;
+        if (other.fd != -1)
+            fd = fcntl(other.fd, F_DUPFD_CLOEXEC, 0);
+    }
+    return *this;
+}
+
+RequestBody::~RequestBody() {
+    closeFile();
+}
+
+void RequestBody::closeFile() {
+    if (fd != -1) {
+        close(fd);
+        fd = -1;
+    }
+}
+
+void RequestBody::configure(size_t new_buffer_size, const std::string& new_temp_path) {
+    buffer_size = new_buffer_size;
+    temp_path = new_temp_path;
+}
+
+// Preallocates memory for a body of known size, unless it will be spooled anyway
+void RequestBody::reserve(size_t size) {
+    if (fd == -1 && size <= buffer_size)
+        memory.reserve(size);
+}
+
+// Moves the body into a temporary file. O_TMPFILE files have no name at all;
+// elsewhere the file is created with mkostemp() and unlinked right away.
+bool RequestBody::spill() {
+    int spool_fd = open(temp_path.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (spool_fd == -1) {
+        std::string name = temp_path + "/webserv_body_XXXXXX";
+        std::vector<char> name_buffer(name.begin(), name.end());
+        name_buffer.push_back('\0');
+        spool_fd = mkostemp(&name_buffer[0], O_CLOEXEC);
+        if (spool_fd == -1) {
+            std::cerr << "Could not create request body file in " << temp_path << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+        unlink(&name_buffer[0]);
+    }
+    fd = spool_fd;
+    size_t written = 0;
+    while (written < memory.size()) {
+        ssize_t result = write(fd, memory.data() + written, memory.size() - written);
+        if (result <= 0) {
+            closeFile();
+            return false;
+        }
+        written += result;
+    }
+    std::string().swap(memory);
+    return true;
+}
+
+// Returns false if the body could not be stored (spool file errors)
+bool RequestBody::append(const char* data, size_t size) {
+    if (size == 0)
+        return true;
+    if (fd == -1 && length + size > buffer_size && !spill())
+        return false;
+    if (fd == -1) {
+        memory.append(data, size);
+        length += size;
+        return true;
+    }
+    size_t written = 0;
+    while (written < size) {
+        ssize_t result = write(fd, data + written, size - written);
+        if (result <= 0)
+            return false;
+        written += result;
+    }
+    length += size;
+    return true;
+}
+
+void RequestBody::clear() {
+    closeFile();
+    std::string().swap(memory);
+    length = 0;
+}
+
+size_t RequestBody::size() const {
+    return length;
+}
+
+bool RequestBody::empty() const {
+    return length == 0;
+}
+
+bool RequestBody::isInFile() const {
+    return fd != -1;
+}
+
+// Copies up to size bytes starting at offset; returns the bytes copied or -1
+ssize_t RequestBody::read(size_t offset, char* out, size_t size) const {
+    if (offset >= length)
+        return 0;
+    size = std::min(size, length - offset);
+    if (fd == -1) {
+        memcpy(out, memory.data() + offset, size);
+        return size;
+    }
+    return pread(fd, out, size, offset);
+}
+
+std::string RequestBody::substr(size_t offset, size_t size) const {
+    if (offset >= length)
+        return "";
+    size = std::min(size, length - offset);
+    if (fd == -1)
+        return memory.substr(offset, size);
+    std::string result(size, '\0');
+    size_t done = 0;
+    while (done < size) {
+        ssize_t result_size = pread(fd, &result[done], size - done, offset + done);
+        if (result_size <= 0)
+            break;
+        done += result_size;
+    }
+    result.resize(done);
+    return result;
+}
+
+std::string RequestBody::str() const {
+    return substr(0, length);
+}
+
+// Writes a range of the body to out_fd; returns false on I/O errors
+bool RequestBody::writeTo(int out_fd, size_t offset, size_t size) const {
+    char buffer[SPOOL_IO_SIZE];
+    size_t end = std::min(length, offset + size);
+    while (offset < end) {
+        ssize_t chunk = read(offset, buffer, std::min(end - offset, sizeof(buffer)));
+        if (chunk <= 0)
+            return false;
+        ssize_t written = 0;
+        while (written < chunk) {
+            ssize_t result = write(out_fd, buffer + written, chunk - written);
+            if (result <= 0)
+                return false;
+            written += result;
+        }
+        offset += chunk;
+    }
+    return true;
+}
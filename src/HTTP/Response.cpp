@@ -2,13 +2,47 @@
 #include "../../include/Utils.hpp"
 #include <fstream>
 #include <sstream>
+#include <iomanip>
 #include <dirent.h>
+#include <sys/sendfile.h>
+#include <sys/random.h>
 
-Response::Response() : status_code(HTTP_OK), is_sent(false), http_version("HTTP/1.1") {
+Response::Response() : status_code(HTTP_OK), is_sent(false), http_version("HTTP/1.1"),
+    body_fd(-1), body_part(0), cached_body(NULL), memory_offset(0) {
     setStatusMessage();
 }
 
-Response::~Response() {}
+// Copies get their own descriptor so each one can close what it owns
+Response::Response(const Response& other) : body_fd(-1), cached_body(NULL) {
+    *this = other;
+}
+
+Response& Response::operator=(const Response& other) {
+    if (this != &other) {
+        closeFileBody();
+        status_code = other.status_code;
+        headers = other.headers;
+        body = other.body;
+        status_message = other.status_message;
+        is_sent = other.is_sent;
+        http_version = other.http_version;
+        body_fd = (other.body_fd != -1) ? fcntl(other.body_fd, F_DUPFD_CLOEXEC, 0) : -1;
+        body_parts = other.body_parts;
+        body_part = other.body_part;
+        if (other.cached_body) {
+            other.cached_body->retain();
+        }
+        releaseCachedBody();
+        cached_body = other.cached_body;
+        memory_offset = other.memory_offset;
+    }
+    return *this;
+}
+
+Response::~Response() {
+    closeFileBody();
+    releaseCachedBody();
+}
 
 void Response::setStatus(int code) {
     status_code = code;
@@ -20,6 +54,8 @@ void Response::setHeader(const std::string& name, const std::string& value) {
 }
 
 void Response::setBody(const std::string& content) {
+    closeFileBody();
+    releaseCachedBody();
     body = content;
     setHeader("Content-Length", Utils::toString(body.length()));
 }
@@ -31,6 +67,8 @@ void Response::setBodyFromFile(const std::string& filename) {
         return;
     }
     
+    closeFileBody();
+    releaseCachedBody();
     std::stringstream buffer;
     buffer << file.rdbuf();
     body = buffer.str();
@@ -41,6 +79,143 @@ void Response::setBodyFromFile(const std::string& filename) {
     Utils::logInfo("Set body from file: " + filename + ", Body length: " + Utils::toString(body.length()) + " bytes.");
 }
 
+// Serves the file straight from its descriptor: only the headers are built in
+// memory, the body is streamed later by sendFileBody()
+bool Response::attachFile(const std::string& filename) {
+    int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return false;
+    }
+    attachDescriptor(fd, st.st_size, filename);
+    return true;
+}
+
+// Takes ownership of fd as the response body
+void Response::attachDescriptor(int fd, off_t size, const std::string& filename) {
+    closeFileBody();
+    releaseCachedBody();
+    body.clear();
+    body_fd = fd;
+    addFilePart(0, size);
+    
+    setHeader("Content-Length", Utils::toString(static_cast<size_t>(size)));
+    setHeader("Content-Type", getContentType(filename));
+}
+
+void Response::addFilePart(off_t offset, size_t length) {
+    BodyPart part;
+    part.offset = offset;
+    part.remaining = length;
+    body_parts.push_back(part);
+}
+
+void Response::addTextPart(const std::string& text) {
+    BodyPart part;
+    part.text = text;
+    part.offset = 0;
+    part.remaining = text.size();
+    body_parts.push_back(part);
+}
+
+size_t Response::getFileBodySize() const {
+    size_t size = 0;
+    for (size_t i = body_part; i < body_parts.size(); ++i) {
+        size += body_parts[i].remaining;
+    }
+    return size;
+}
+
+void Response::closeFileBody() {
+    if (body_fd != -1) {
+        close(body_fd);
+        body_fd = -1;
+    }
+    body_parts.clear();
+    body_part = 0;
+}
+
+void Response::releaseCachedBody() {
+    if (cached_body) {
+        cached_body->release();
+        cached_body = NULL;
+    }
+    memory_offset = 0;
+}
+
+bool Response::hasMemoryBody() const {
+    return memory_offset < (cached_body ? cached_body->getBody() : body).size();
+}
+
+const char* Response::getMemoryData() const {
+    return (cached_body ? cached_body->getBody() : body).data() + memory_offset;
+}
+
+size_t Response::getMemoryRemaining() const {
+    return (cached_body ? cached_body->getBody() : body).size() - memory_offset;
+}
+
+// Once the whole body is out, the cache entry is let go and a generated body freed
+void Response::consumeMemoryBody(size_t bytes) {
+    memory_offset += bytes;
+    if (cached_body) {
+        if (memory_offset >= cached_body->getBody().size()) {
+            releaseCachedBody();
+        }
+    } else if (memory_offset >= body.size()) {
+        std::string().swap(body);
+        memory_offset = 0;
+    }
+}
+
+bool Response::hasFileBody() const {
+    return body_fd != -1 && body_part < body_parts.size();
+}
+
+// Sends text parts as far as the socket takes them and at most max_bytes of
+// the file. Returns the bytes sent, or -1 with errno set (EAGAIN when the
+// socket is full).
+ssize_t Response::sendFileBody(int socket_fd, size_t max_bytes) {
+    ssize_t total = 0;
+    while (body_part < body_parts.size()) {
+        BodyPart& part = body_parts[body_part];
+        bool is_text = !part.text.empty();
+        ssize_t sent;
+        if (is_text) {
+            sent = send(socket_fd, part.text.data() + part.offset, part.remaining, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (sent > 0) {
+                part.offset += sent;
+            }
+        } else {
+            sent = sendfile(socket_fd, body_fd, &part.offset, std::min(part.remaining, max_bytes));
+            if (sent == 0) {
+                // File shrank underneath us: nothing left to send
+                errno = EIO;
+                sent = -1;
+            }
+        }
+        if (sent <= 0) {
+            return total > 0 ? total : sent;
+        }
+        total += sent;
+        part.remaining -= sent;
+        if (part.remaining == 0) {
+            body_part++;
+        }
+        if (!is_text || part.remaining > 0) {
+            break; // One file slice per call, or the socket is full
+        }
+    }
+    if (body_part == body_parts.size()) {
+        closeFileBody();
+    }
+    return total;
+}
+
 void Response::setStatusMessage() {
     switch (status_code) {
         case HTTP_OK:
@@ -351,7 +526,8 @@ std::string Response::generateDirectoryListing(const std::string& path, const st
                 }
                 
                 char time_str[100];
-                strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", localtime(&st.st_mtime));
+                struct tm mtime;
+                strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", localtime_r(&st.st_mtime, &mtime));
                 html << "            <td>" << time_str << "</td>\n";
                 html << "        </tr>\n";
             }
@@ -367,7 +543,7 @@ std::string Response::generateDirectoryListing(const std::string& path, const st
     return html.str();
 }
 
-void Response::sendFile(const std::string& filename) {
+void Response::sendFile(const std::string& filename, bool zero_copy) {
     if (!Utils::fileExists(filename)) {
         sendError(HTTP_NOT_FOUND);
         return;
@@ -379,82 +555,213 @@ void Response::sendFile(const std::string& filename) {
     }
     
     setStatus(HTTP_OK);
+    if (zero_copy && attachFile(filename)) {
+        return;
+    }
     setBodyFromFile(filename);
 }
 
-void Response::sendError(int code, const std::string& custom_message) {
-    setStatus(code);
-    setHeader("Content-Type", CONTENT_TYPE_HTML);
-    
-    if (!custom_message.empty()) {
-        setBody(custom_message);
-    } else {
-        setBody(generateErrorPage(code));
-    }
+// 200 with a body and header lines taken from the static cache; the body is
+// written from the cache itself and never copied into the response
+void Response::sendCached(StaticCache::Entry& entry) {
+    closeFileBody();
+    releaseCachedBody();
+    body.clear();
+    headers.erase("Content-Type");
+    headers.erase("Content-Length");
+    setStatus(HTTP_OK);
+    entry.retain();
+    cached_body = &entry;
+    memory_offset = 0;
 }
 
-void Response::sendError(int code, const ServerConfig& config, const std::string& root_path) {
-    setStatus(code);
-    setHeader("Content-Type", CONTENT_TYPE_HTML);
+// Same as above with the checks already answered by the open file cache; the
+// cached descriptor is duplicated, the cache keeps its own
+void Response::sendFile(const std::string& filename, const OpenFileCache::File& file, bool zero_copy) {
+    if (!file.exists) {
+        sendError(HTTP_NOT_FOUND);
+        return;
+    }
     
-    // Try template-based error pages first
-    std::string template_page = generateTemplateErrorPage(code, root_path);
-    if (!template_page.empty()) {
-        setBody(template_page);
+    if (!file.readable) {
+        sendError(HTTP_FORBIDDEN);
         return;
     }
     
-    // Try to use custom error page from config
-    if (!tryCustomErrorPage(code, config.error_pages, root_path)) {
-        // Fall back to default error page
-        setBody(generateErrorPage(code));
+    setStatus(HTTP_OK);
+    setValidators(file.st);
+    if (zero_copy && file.fd != -1) {
+        int fd = fcntl(file.fd, F_DUPFD_CLOEXEC, 0);
+        if (fd != -1) {
+            attachDescriptor(fd, file.st.st_size, filename);
+            return;
+        }
     }
+    setBodyFromFile(filename);
+}
+
+// Header-only answer to a conditional GET whose validators still match
+void Response::sendNotModified(const struct stat& st) {
+    closeFileBody();
+    releaseCachedBody();
+    body.clear();
+    headers.erase("Content-Type");
+    headers.erase("Content-Length");
+    setStatus(HTTP_NOT_MODIFIED);
+    setValidators(st);
 }
 
-bool Response::tryCustomErrorPage(int code, const std::map<int, std::string>& error_pages, const std::string& root_path) {
-    std::map<int, std::string>::const_iterator it = error_pages.find(code);
-    if (it != error_pages.end()) {
-        std::string error_page_path = root_path + it->second;
-        if (Utils::fileExists(error_page_path)) {
-            setBodyFromFile(error_page_path);
-            return true;
+// Parses "bytes=first-last, first-, -suffix" (RFC 7233) against a body of
+// size bytes. Malformed headers and other units are ignored, as are headers
+// with more than MAX_BYTE_RANGES ranges.
+Response::RangeStatus Response::parseRanges(const std::string& header, off_t size, std::vector<ByteRange>& ranges) {
+    ranges.clear();
+    std::string value = Utils::trim(header);
+    if (Utils::toLower(value.substr(0, 6)) != "bytes=") {
+        return RANGE_IGNORED;
+    }
+    std::vector<std::string> specs = Utils::split(value.substr(6), ',');
+    if (specs.empty() || specs.size() > MAX_BYTE_RANGES) {
+        return RANGE_IGNORED;
+    }
+    for (size_t i = 0; i < specs.size(); ++i) {
+        std::string spec = Utils::trim(specs[i]);
+        size_t dash = spec.find('-');
+        if (dash == std::string::npos) {
+            return RANGE_IGNORED;
+        }
+        std::string first_text = spec.substr(0, dash);
+        std::string last_text = spec.substr(dash + 1);
+        if ((first_text.empty() && last_text.empty())
+            || first_text.find_first_not_of("0123456789") != std::string::npos
+            || last_text.find_first_not_of("0123456789") != std::string::npos) {
+            return RANGE_IGNORED;
+        }
+        ByteRange range;
+        if (first_text.empty()) {
+            // Suffix range: the last N bytes
+            off_t suffix = strtoll(last_text.c_str(), NULL, 10);
+            if (suffix == 0 || size == 0) {
+                continue;
+            }
+            range.first = (suffix < size) ? size - suffix : 0;
+            range.last = size - 1;
         } else {
-            Utils::logError("Custom error page not found: " + error_page_path);
+            range.first = strtoll(first_text.c_str(), NULL, 10);
+            range.last = last_text.empty() ? range.first : strtoll(last_text.c_str(), NULL, 10);
+            if (range.last < range.first) {
+                return RANGE_IGNORED;
+            }
+            if (last_text.empty()) {
+                range.last = size - 1;
+            }
+            if (range.first >= size) {
+                continue;
+            }
+            range.last = std::min(range.last, size - 1);
         }
+        ranges.push_back(range);
     }
-    return false;
+    return ranges.empty() ? RANGE_UNSATISFIABLE : RANGE_SATISFIABLE;
 }
 
-std::string Response::generateTemplateErrorPage(int code, const std::string& root_path) {
-    // Determine which template to use based on error code
-    std::string template_file;
-    int code_class = code / 100;
+// multipart/byteranges boundary: random, so it says nothing about the server
+// and cannot be guessed ahead to collide with the file's contents. A counter
+// stands in if the kernel has no randomness to give yet.
+static std::string makeBoundary() {
+    static unsigned long fallback = 0;
+    unsigned long value;
+    if (getrandom(&value, sizeof(value), GRND_NONBLOCK) != static_cast<ssize_t>(sizeof(value))) {
+        value = __sync_add_and_fetch(&fallback, 1);
+    }
+    std::ostringstream boundary;
+    boundary << std::hex << std::setw(16) << std::setfill('0') << value;
+    return boundary.str();
+}
+
+// 206 with only the requested slices of the file: a single range goes out
+// as-is, several as multipart/byteranges. Slices are sent with sendfile() from
+// a duplicate of the cached descriptor, or read with pread() when zero copy
+// is off.
+void Response::sendRanges(const std::string& filename, const OpenFileCache::File& file, const std::vector<ByteRange>& ranges, bool zero_copy) {
+    closeFileBody();
+    releaseCachedBody();
+    body.clear();
+    setStatus(HTTP_PARTIAL_CONTENT);
+    setValidators(file.st);
     
-    switch (code_class) {
-        case 4:
-            template_file = root_path + "/4xx.html";
-            break;
-        case 5:
-            template_file = root_path + "/5xx.html";
-            break;
-        case 6:
-            template_file = root_path + "/6xx.html";
-            break;
-        default:
-            // Fall back to generating standard error page
-            return generateErrorPage(code);
+    std::string content_type = getContentType(filename);
+    std::string total = Utils::toString(static_cast<size_t>(file.st.st_size));
+    if (ranges.size() == 1) {
+        addFilePart(ranges[0].first, ranges[0].last - ranges[0].first + 1);
+        setHeader("Content-Type", content_type);
+        setHeader("Content-Range", "bytes " + Utils::toString(static_cast<size_t>(ranges[0].first)) + "-"
+            + Utils::toString(static_cast<size_t>(ranges[0].last)) + "/" + total);
+    } else {
+        std::string boundary = makeBoundary();
+        for (size_t i = 0; i < ranges.size(); ++i) {
+            addTextPart((i == 0 ? "--" : "\r\n--") + boundary + "\r\n"
+                + "Content-Type: " + content_type + "\r\n"
+                + "Content-Range: bytes " + Utils::toString(static_cast<size_t>(ranges[i].first)) + "-"
+                + Utils::toString(static_cast<size_t>(ranges[i].last)) + "/" + total + "\r\n\r\n");
+            addFilePart(ranges[i].first, ranges[i].last - ranges[i].first + 1);
+        }
+        addTextPart("\r\n--" + boundary + "--\r\n");
+        setHeader("Content-Type", "multipart/byteranges; boundary=" + boundary);
     }
+    setHeader("Content-Length", Utils::toString(getFileBodySize()));
     
-    // Check if template exists
-    if (Utils::fileExists(template_file)) {
-        std::string template_content = Utils::readFile(template_file);
-        if (!template_content.empty()) {
-            return replacePlaceholders(template_content, code);
+    if (zero_copy) {
+        body_fd = fcntl(file.fd, F_DUPFD_CLOEXEC, 0);
+        if (body_fd != -1) {
+            return;
         }
     }
+    // Copy the slices into memory instead
+    std::vector<BodyPart> parts;
+    parts.swap(body_parts);
+    body_part = 0;
+    for (size_t i = 0; i < parts.size(); ++i) {
+        if (!parts[i].text.empty()) {
+            body += parts[i].text;
+            continue;
+        }
+        size_t start = body.size();
+        body.resize(start + parts[i].remaining);
+        size_t done = 0;
+        while (done < parts[i].remaining) {
+            ssize_t result = pread(file.fd, &body[start + done], parts[i].remaining - done, parts[i].offset + done);
+            if (result <= 0) {
+                headers.erase("Content-Range");
+                sendError(HTTP_INTERNAL_SERVER_ERROR);
+                return;
+            }
+            done += result;
+        }
+    }
+}
+
+void Response::setValidators(const struct stat& st) {
+    setHeader("Accept-Ranges", "bytes");
+    setHeader("Last-Modified", Utils::formatHttpDate(st.st_mtime));
+    setHeader("ETag", Utils::makeETag(st));
+}
+
+void Response::sendError(int code, const std::string& custom_message) {
+    setStatus(code);
+    setHeader("Content-Type", CONTENT_TYPE_HTML);
     
-    // Fall back to generating standard error page
-    return generateErrorPage(code);
+    if (!custom_message.empty()) {
+        setBody(custom_message);
+    } else {
+        setBody(generateErrorPage(code));
+    }
+}
+
+// Error status with a precompiled page, sent from the page's shared buffer
+void Response::sendError(int code, StaticCache::Entry& page) {
+    sendCached(page);
+    setStatus(code);
 }
 
 std::string Response::replacePlaceholders(const std::string& template_content, int code) {
@@ -524,58 +831,77 @@ bool Response::isSent() const {
 }
 
 // Response building
-std::string Response::buildResponse() {
-    return buildResponse("HTTP/1.1");
-}
-
-std::string Response::buildResponse(const std::string& request_version) {
-    std::ostringstream response;
-    
-    // Determine response version based on request version
-    std::string response_version = request_version;
-    if (request_version == "HTTP/1.0") {
-        response_version = "HTTP/1.0";
-    } else {
-        response_version = "HTTP/1.1";
+// "HTTP/1.x <code> <reason>\r\n" for every code, built once per process
+struct StatusLineTable {
+    enum { FIRST = 100, LAST = 599 };
+    std::string lines[2][LAST - FIRST + 1];
+
+    StatusLineTable() {
+        for (int code = FIRST; code <= LAST; ++code) {
+            std::string rest = " " + Utils::toString(code) + " " + Utils::getStatusMessage(code) + "\r\n";
+            lines[0][code - FIRST] = "HTTP/1.0" + rest;
+            lines[1][code - FIRST] = "HTTP/1.1" + rest;
+        }
     }
+};
+
+// Appends the status line and header block to out, which the caller reuses
+// between responses. The body is not copied: it is written in place from
+// getMemoryData() or streamed by sendFileBody().
+void Response::buildHeaders(const std::string& request_version, const std::string& date, std::string& out) const {
+    static const StatusLineTable status_lines; // first use builds it, guarded by the compiler
+    bool http10 = (request_version == "HTTP/1.0");
     
     // Status line
-    response << response_version << " " << status_code << " " << status_message << "\r\n";
+    if (status_code >= StatusLineTable::FIRST && status_code <= StatusLineTable::LAST) {
+        out += status_lines.lines[http10 ? 0 : 1][status_code - StatusLineTable::FIRST];
+    } else {
+        out += http10 ? "HTTP/1.0 " : "HTTP/1.1 ";
+        out += Utils::toString(status_code) + " " + status_message + "\r\n";
+    }
     
     // Add Server header (nginx-like)
-    response << "Server: webserv/1.0\r\n";
+    out += "Server: webserv/1.0\r\n";
     
     // Add Date header
-    time_t now = time(0);
-    struct tm* gmt = gmtime(&now);
-    char date_buffer[100];
-    strftime(date_buffer, sizeof(date_buffer), "%a, %d %b %Y %H:%M:%S GMT", gmt);
-    response << "Date: " << date_buffer << "\r\n";
+    out += "Date: ";
+    out += date;
+    out += "\r\n";
     
     // Headers
     for (std::map<std::string, std::string>::const_iterator it = headers.begin(); 
          it != headers.end(); ++it) {
-        response << it->first << ": " << it->second << "\r\n";
+        out += it->first;
+        out += ": ";
+        out += it->second;
+        out += "\r\n";
     }
     
-    // Handle Connection header based on HTTP version
-    if (response_version == "HTTP/1.0") {
-        // HTTP/1.0 defaults to Connection: close
-        if (headers.find("Connection") == headers.end()) {
-            response << "Connection: close\r\n";
-        }
-    } else {
-        // HTTP/1.1 defaults to Connection: keep-alive, but we use close for simplicity
-        response << "Connection: close\r\n";
+    // Content-Type, Content-Length, Last-Modified and ETag of a cached body
+    if (cached_body) {
+        out += cached_body->getHeaders();
     }
     
-    // Empty line to separate headers from body
-    response << "\r\n";
-    
-    // Body
-    response << body;
+    // Keep-alive is negotiated by the caller through the Connection header;
+    // without one the connection is closed after this response
+    if (headers.find("Connection") == headers.end()) {
+        out += "Connection: close\r\n";
+    }
     
-    return response.str();
+    // Empty line to separate headers from body
+    out += "\r\n";
+}
+
+std::string Response::buildResponse() {
+    return buildResponse("HTTP/1.1");
+}
+
+// Whole response in one string, for callers that cannot send the body in place
+std::string Response::buildResponse(const std::string& request_version) {
+    std::string response;
+    buildHeaders(request_version, Utils::formatHttpDate(time(0)), response);
+    response.append(getMemoryData(), getMemoryRemaining());
+    return response;
 }
 
 void Response::markAsSent() {
@@ -586,6 +912,8 @@ void Response::reset() {
     status_code = HTTP_OK;
     headers.clear();
     body.clear();
+    closeFileBody();
+    releaseCachedBody();
     setStatusMessage();
     is_sent = false;
     http_version = "HTTP/1.1";
@@ -601,7 +929,7 @@ void Response::print() const {
         std::cout << "    " << it->first << ": " << it->second << std::endl;
     }
     
-    std::cout << "  Body Length: " << body.length() << std::endl;
+    std::cout << "  Body Length: " << (body_fd != -1 ? getFileBodySize() : body.length()) << std::endl;
     std::cout << "  Is Sent: " << (is_sent ? "Yes" : "No") << std::endl;
 }
 
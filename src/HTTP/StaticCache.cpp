@@ -0,0 +1,143 @@
+#include "../../include/StaticCache.hpp"
+#include "../../include/Utils.hpp"
+
+StaticCache::Entry::Entry() : ino(0), dev(0), size(0), mtime(0), refs(1) {
+}
+
+// A free-standing entry for other shared bodies (error pages); the caller owns
+// the first reference
+StaticCache::Entry* StaticCache::Entry::create(const std::string& headers, const std::string& body) {
+    Entry* entry = new Entry();
+    entry->headers = headers;
+    entry->body = body;
+    entry->size = body.size();
+    return entry;
+}
+
+const std::string& StaticCache::Entry::getHeaders() const {
+    return headers;
+}
+
+const std::string& StaticCache::Entry::getBody() const {
+    return body;
+}
+
+// Atomic: error pages are shared by every worker
+void StaticCache::Entry::retain() {
+    __sync_add_and_fetch(&refs, 1);
+}
+
+void StaticCache::Entry::release() {
+    if (__sync_sub_and_fetch(&refs, 1) == 0)
+        delete this;
+}
+
+StaticCache::StaticCache() : capacity(0), used(0), hits(0), misses(0) {
+}
+
+StaticCache::~StaticCache() {
+    while (!entries.empty())
+        evict(entries.begin());
+}
+
+void StaticCache::configure(size_t new_capacity) {
+    capacity = new_capacity;
+    while (used > capacity)
+        evict(entries.find(lru.back()));
+}
+
+bool StaticCache::isEnabled() const {
+    return capacity > 0;
+}
+
+// The cache drops its reference; responses still sending the entry keep theirs
+void StaticCache::evict(EntryMap::iterator it) {
+    Entry* entry = it->second;
+    used -= entry->headers.size() + entry->body.size();
+    lru.erase(entry->lru);
+    entries.erase(it);
+    entry->release();
+}
+
+bool StaticCache::isSameFile(const Entry& entry, const struct stat& st) {
+    return entry.ino == st.st_ino && entry.dev == st.st_dev
+        && entry.size == st.st_size && entry.mtime == st.st_mtime;
+}
+
+// Reads the whole file through the open file cache's descriptor
+StaticCache::Entry* StaticCache::load(const std::string& path, const OpenFileCache::File& file) {
+    Entry* entry = new Entry();
+    entry->body.resize(file.st.st_size);
+    size_t done = 0;
+    while (done < entry->body.size()) {
+        ssize_t result = pread(file.fd, &entry->body[done], entry->body.size() - done, done);
+        if (result <= 0) {
+            delete entry;
+            return NULL;
+        }
+        done += result;
+    }
+    entry->ino = file.st.st_ino;
+    entry->dev = file.st.st_dev;
+    entry->size = file.st.st_size;
+    entry->mtime = file.st.st_mtime;
+    entry->headers = "Content-Type: " + Utils::getMimeType(path) + "\r\n"
+        + "Content-Length: " + Utils::toString(entry->body.size()) + "\r\n"
+        + "Last-Modified: " + Utils::formatHttpDate(entry->mtime) + "\r\n"
+        + "ETag: " + Utils::makeETag(file.st) + "\r\n"
+        + "Accept-Ranges: bytes\r\n";
+    return entry;
+}
+
+// Returns the cached copy of a readable regular file, loading it on a miss.
+// NULL means the file is not cacheable (too large, unreadable) and should be
+// served from disk.
+StaticCache::Entry* StaticCache::lookup(const std::string& path, const OpenFileCache::File& file, size_t max_file_size) {
+    if (!isEnabled() || file.fd == -1)
+        return NULL;
+
+    EntryMap::iterator it = entries.find(path);
+    if (it != entries.end()) {
+        if (isSameFile(*it->second, file.st)) {
+            hits++;
+            lru.splice(lru.begin(), lru, it->second->lru);
+            return it->second;
+        }
+        evict(it);
+    }
+
+    misses++;
+    if (static_cast<size_t>(file.st.st_size) > max_file_size)
+        return NULL;
+    Entry* entry = load(path, file);
+    if (!entry)
+        return NULL;
+    size_t entry_size = entry->headers.size() + entry->body.size();
+    if (entry_size > capacity) {
+        delete entry;
+        return NULL;
+    }
+    while (used + entry_size > capacity)
+        evict(entries.find(lru.back()));
+    lru.push_front(path);
+    entry->lru = lru.begin();
+    entries[path] = entry;
+    used += entry_size;
+    return entry;
+}
+
+unsigned long StaticCache::getHits() const {
+    return hits;
+}
+
+unsigned long StaticCache::getMisses() const {
+    return misses;
+}
+
+size_t StaticCache::getUsed() const {
+    return used;
+}
+
+size_t StaticCache::getCount() const {
+    return entries.size();
+}
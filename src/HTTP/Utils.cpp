@@ -177,6 +177,7 @@ std::string Utils::getStatusMessage(int status_code) {
         case 201: return "Created";
         case 202: return "Accepted";
         case 204: return "No Content";
+        case 206: return "Partial Content";
         
         // 3xx Redirection
         case 301: return "Moved Permanently";
@@ -250,13 +251,50 @@ std::string Utils::getStatusMessage(int status_code) {
 
 std::string Utils::getCurrentTime() {
     std::time_t now = std::time(NULL);
-    std::tm* tm_info = std::localtime(&now);
+    std::tm tm_info;
+    localtime_r(&now, &tm_info);
     
     char buffer[80];
-    std::strftime(buffer, 80, "%Y-%m-%d %H:%M:%S", tm_info);
+    std::strftime(buffer, 80, "%Y-%m-%d %H:%M:%S", &tm_info);
     return std::string(buffer);
 }
 
+// IMF-fixdate (RFC 7231), as used by Date and Last-Modified
+std::string Utils::formatHttpDate(time_t time) {
+    std::tm gmt;
+    gmtime_r(&time, &gmt);
+    
+    char buffer[64];
+    std::strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", &gmt);
+    return std::string(buffer);
+}
+
+// Accepts the three date formats RFC 7231 asks recipients to understand
+bool Utils::parseHttpDate(const std::string& date, time_t& time) {
+    static const char* formats[] = {
+        "%a, %d %b %Y %H:%M:%S GMT",   // IMF-fixdate
+        "%A, %d-%b-%y %H:%M:%S GMT",   // RFC 850
+        "%a %b %e %H:%M:%S %Y"         // asctime()
+    };
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); ++i) {
+        std::tm gmt;
+        std::memset(&gmt, 0, sizeof(gmt));
+        const char* end = strptime(date.c_str(), formats[i], &gmt);
+        if (end && *end == '\0') {
+            time = timegm(&gmt);
+            return time != static_cast<time_t>(-1);
+        }
+    }
+    return false;
+}
+
+// Strong validator from inode, size and modification time
+std::string Utils::makeETag(const struct stat& st) {
+    std::ostringstream etag;
+    etag << std::hex << "\"" << st.st_ino << "-" << st.st_size << "-" << st.st_mtime << "\"";
+    return etag.str();
+}
+
 // Path operations
 std::string Utils::joinPath(const std::string& path1, const std::string& path2) {
     if (path1.empty()) return path2;
@@ -2,6 +2,9 @@
 #include "../../include/signals.hpp"
 #include "../../include/parse.hpp"
 #include "../../include/polling.hpp"
+#include "../../include/VirtualHosts.hpp"
+#include "../../include/CGIZygote.hpp"
+#include <algorithm>
 
 int	help(char *cmd)
 {
@@ -44,27 +47,44 @@ int main(int argc, char *argv[])
 	servers = parse(config_file); // 4. Get the servers-vector
 	if (servers.empty())
 		return (1);
-	{ // 5. run all valid servers
+	for (std::vector<Server>::iterator it = servers.begin(); it != servers.end(); it++)
+		it->compile(); // Servers stay at these addresses; the request path only reads them from here on
+	ErrorPageCache	error_pages; // rendered once here, read by every worker
+	for (std::vector<Server>::iterator it = servers.begin(); it != servers.end(); it++)
+		error_pages.compile(*it);
+	int worker_count = 1; // the process runs as many event loops as the largest worker_threads asks for
+	for (std::vector<Server>::iterator it = servers.begin(); it != servers.end(); it++)
+		worker_count = std::max(worker_count, it->get_worker_threads());
+	CGIZygote	zygote; // forked before any socket exists, so scripts start from a small image
+	if (!zygote.start(worker_count))
+		std::cout << "CGI zygote unavailable, scripts are forked by the workers" << std::endl;
+	std::vector<VirtualHosts>	hosts;
+	std::vector<Worker>	workers(worker_count);
+	{ // 5. run all valid servers, one set of SO_REUSEPORT listeners per worker and address:port
 		try
 		{
-			for (std::vector<Server>::iterator it = servers.begin(); it != servers.end(); it++)
-				it->run();
+			hosts = VirtualHosts::group(servers); // server blocks sharing an address:port are told apart by Host
+			for (int w = 0; w < worker_count; w++)
+			{
+				workers[w].id = w;
+				workers[w].zygote_fd = zygote.getChannel(w);
+				workers[w].error_pages = &error_pages;
+				for (std::vector<VirtualHosts>::iterator it = hosts.begin(); it != hosts.end(); it++)
+					workers[w].listeners[it->listen()] = &(*it);
+			}
 		}
 		catch (RuntimeException& e)
 		{
 			std::cout << "Error while running a server: " << e.what() << std::endl;
 
-			// close all running servers
-			for (std::vector<Server>::iterator it = servers.begin(); it != servers.end() && (*it).is_active(); it++)
-				(*it).shutdown();
+			// close all running listeners
+			for (std::vector<VirtualHosts>::iterator it = hosts.begin(); it != hosts.end(); it++)
+				it->shutdown();
 			return (1);
 		}
     }
-	while (sigint_pressed == 0)
-	{
-	polling(servers); // 6. Loop (until SIGINT) and poll all configured servers
-	}
-	for (std::vector<Server>::iterator it = servers.begin(); it != servers.end(); it++) // 7. Stop the servers and free the ports
-	it->shutdown();
-	return (0);
+	bool clean = run_workers(workers); // 6. Loop (until SIGINT) and poll all configured servers
+	for (std::vector<VirtualHosts>::iterator it = hosts.begin(); it != hosts.end(); it++) // 7. Stop the servers and free the ports
+		it->shutdown();
+	return (clean ? 0 : 1);
 }
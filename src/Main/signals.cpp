@@ -1,16 +1,17 @@
 #include <iostream>
 #include <csignal>
 
-volatile bool	sigint_pressed;
+volatile sig_atomic_t	sigint_pressed;
 
 void	sigint_handler( int signal )
 {
 	(void) signal;
-	sigint_pressed = true;
+	sigint_pressed = 1;
 }
 
 void	set_sigint( void )
 {
-	sigint_pressed = false;
+	sigint_pressed = 0;
 	signal(SIGINT, sigint_handler);
+	signal(SIGPIPE, SIG_IGN); // A script exiting early must not kill us while we feed its stdin
 }
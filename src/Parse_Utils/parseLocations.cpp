@@ -1,5 +1,20 @@
 #include "../../include/parse.hpp"
 
+// Splits "[= | ^~] path" into its nginx modifier and path
+static std::string	split_location_modifier( const std::string& spec, Location::Match& match ) {
+
+	match = Location::MATCH_PREFIX;
+	if ( spec.compare(0, 2, "= ") == 0 ) {
+		match = Location::MATCH_EXACT;
+		return spec.substr(2);
+	}
+	if ( spec.compare(0, 3, "^~ ") == 0 ) {
+		match = Location::MATCH_PREFIX_PRIORITY;
+		return spec.substr(3);
+	}
+	return spec;
+}
+
 bool	is_location( const std::string directive_line ) {
 
 	// Verify that it starts with the word location
@@ -9,16 +24,17 @@ bool	is_location( const std::string directive_line ) {
 	size_t last_space = directive_line.rfind(' ');
 	if ( last_space == std::string::npos || last_space == 8 || directive_line.at( directive_line.size() - 1 ) != '{' ) return false;
 
-	// Verify that there is a valid name for the location
-	std::string location_path = directive_line.substr(9, last_space - 9);
+	// Verify that there is a valid name for the location, after an optional modifier
+	Location::Match match;
+	std::string location_path = split_location_modifier( directive_line.substr(9, last_space - 9), match );
 	// Path must be "/" or start with "/" and not end with "/" (except root)
 	return !location_path.empty() && (!location_path.compare("/") || (location_path.at(0) == '/' && location_path.at( location_path.size() - 1 ) != '/'));
 }
 
-static bool check_duplicate_location( Server target_server, std::string location_path ) {
+static bool check_duplicate_location( Server const& target_server, std::string const& location_path ) {
 
 	// Get server locations
-	std::map<std::string, Location>	existing_locations = target_server.get_locations();
+	std::map<std::string, Location> const&	existing_locations = target_server.get_locations();
 
 	// Verify there is no duplicate locations
 	std::map<std::string, Location>::const_iterator location_it = existing_locations.find( location_path );
@@ -28,15 +44,18 @@ static bool check_duplicate_location( Server target_server, std::string location
 int	processLocationBlock( std::ifstream &input_stream, std::string &current_line, Server &target_server, std::map<std::string, Function> location_handlers ) {
 	
 
-	// Get route of Location
-	std::string location_path = current_line.substr( 9, current_line.rfind(' ') - 9 );
+	// Get route of Location; exact locations are keyed apart from prefix ones
+	Location::Match match;
+	std::string location_path = split_location_modifier( current_line.substr( 9, current_line.rfind(' ') - 9 ), match );
+	std::string location_key = ( match == Location::MATCH_EXACT ? "= " + location_path : location_path );
 
 	// Verify duplicate Locations
-	if ( check_duplicate_location( target_server, location_path ) )
+	if ( check_duplicate_location( target_server, location_key ) )
 		return 0; // Reject duplicate location
 
 	// Create new Location
 	Location new_location( location_path );
+	new_location.setMatch( match );
 
 	// Read lines inside a location block
 	while (std::getline( input_stream, current_line )) {
@@ -47,7 +66,7 @@ int	processLocationBlock( std::ifstream &input_stream, std::string &current_line
 		// Case end of Location
 		if ( current_line.compare("}") == 0 ) {
 
-			target_server.add_location( location_path, new_location );
+			target_server.add_location( location_key, new_location );
 			break;
 		}
 		// Case empty line or comment
@@ -0,0 +1,127 @@
+#include "../../include/TimerWheel.hpp"
+#include <ctime>
+
+TimerNode::TimerNode() : prev(NULL), next(NULL), expires(0), owner(NULL) {
+}
+
+TimerNode::TimerNode(const TimerNode& other) : prev(NULL), next(NULL), expires(0), owner(other.owner) {
+}
+
+// Links belong to the wheel, not to the value: keep our own
+TimerNode& TimerNode::operator=(const TimerNode& other) {
+    owner = other.owner;
+    return *this;
+}
+
+TimerNode::~TimerNode() {
+    cancel();
+}
+
+bool TimerNode::isArmed() const {
+    return next != NULL;
+}
+
+void TimerNode::cancel() {
+    if (!isArmed())
+        return;
+    prev->next = next;
+    next->prev = prev;
+    prev = NULL;
+    next = NULL;
+}
+
+void TimerNode::link(TimerNode& head) {
+    prev = head.prev;
+    next = &head;
+    head.prev->next = this;
+    head.prev = this;
+}
+
+void* TimerNode::getOwner() const {
+    return owner;
+}
+
+void TimerNode::setOwner(void* new_owner) {
+    owner = new_owner;
+}
+
+TimerWheel::TimerWheel() : current(now() / TICK_MS) {
+    for (unsigned long i = 0; i < NEAR_SLOTS; ++i)
+        near[i].prev = near[i].next = &near[i];
+    for (unsigned long i = 0; i < FAR_SLOTS; ++i)
+        far[i].prev = far[i].next = &far[i];
+}
+
+unsigned long TimerWheel::now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<unsigned long>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Re-arms the node for deadline_ms (monotonic), replacing any earlier deadline
+void TimerWheel::arm(TimerNode& node, unsigned long deadline_ms) {
+    node.cancel();
+    node.expires = (deadline_ms + TICK_MS - 1) / TICK_MS;
+    insert(node);
+}
+
+void TimerWheel::insert(TimerNode& node) {
+    if (node.expires < current)
+        node.expires = current;
+    unsigned long delta = node.expires - current;
+    if (delta < NEAR_SLOTS) {
+        node.link(near[node.expires & (NEAR_SLOTS - 1)]);
+        return;
+    }
+    // Beyond the far wheel: park in its last slot, the next cascade re-files it
+    unsigned long slot_tick = node.expires;
+    if (delta >= NEAR_SLOTS * FAR_SLOTS)
+        slot_tick = current + NEAR_SLOTS * FAR_SLOTS - 1;
+    node.link(far[(slot_tick >> NEAR_BITS) & (FAR_SLOTS - 1)]);
+}
+
+// Moves the far slot of the block starting at `current` down into the near wheel
+void TimerWheel::cascade() {
+    TimerNode& head = far[(current >> NEAR_BITS) & (FAR_SLOTS - 1)];
+    while (head.next != &head) {
+        TimerNode* node = head.next;
+        node->cancel();
+        insert(*node);
+    }
+}
+
+// Collects the owners of every timer due by now_ms; fired nodes end up unarmed
+void TimerWheel::expire(unsigned long now_ms, std::vector<void*>& fired) {
+    unsigned long target = now_ms / TICK_MS;
+    while (current <= target) {
+        if ((current & (NEAR_SLOTS - 1)) == 0)
+            cascade();
+        TimerNode& head = near[current & (NEAR_SLOTS - 1)];
+        while (head.next != &head) {
+            TimerNode* node = head.next;
+            node->cancel();
+            fired.push_back(node->owner);
+        }
+        ++current;
+    }
+}
+
+// Milliseconds until the earliest timer is due, at most max_ms (the epoll_wait timeout)
+int TimerWheel::nextTimeout(unsigned long now_ms, int max_ms) const {
+    unsigned long ticks = max_ms / TICK_MS + 1;
+    for (unsigned long i = 0; i < ticks && i < NEAR_SLOTS; ++i) {
+        unsigned long tick = current + i;
+        bool due = near[tick & (NEAR_SLOTS - 1)].next != &near[tick & (NEAR_SLOTS - 1)];
+        if (!due && i > 0 && (tick & (NEAR_SLOTS - 1)) == 0) {
+            const TimerNode& head = far[(tick >> NEAR_BITS) & (FAR_SLOTS - 1)];
+            due = head.next != &head;
+        }
+        if (due) {
+            unsigned long when = tick * TICK_MS;
+            if (when <= now_ms)
+                return 0;
+            return (when - now_ms < static_cast<unsigned long>(max_ms)) ? static_cast<int>(when - now_ms) : max_ms;
+        }
+    }
+    return max_ms;
+}
@@ -2,62 +2,177 @@
 #include "../../include/signals.hpp"
 #include "../../include/default.hpp"
 #include <cstring>
+#include <algorithm>
+#include <csignal>
 
 #define MAX_EVENTS 128
 
-void polling(std::vector<Server> servers_vector)
+// Set when a worker could not start or set up its loop. Its listeners are
+// bound already and the kernel keeps handing them connections, so the other
+// workers stop as well and the server exits. Written once, polled like
+// sigint_pressed.
+static volatile int workers_failed = 0;
+
+static void fail_workers()
+{
+    __sync_lock_test_and_set(&workers_failed, 1);
+}
+
+void polling(Worker& worker)
 {
-    std::map<int, Server> servers;
-    std::map<int, Client> clients;
-    std::vector<Server>::const_iterator serv_it;
-    for (serv_it = servers_vector.begin(); serv_it != servers_vector.end(); ++serv_it)
-    {
-        std::vector<int> sockets = serv_it->get_sockets();
-        std::vector<int>::const_iterator sock_it;
-        for (sock_it = sockets.begin(); sock_it != sockets.end(); ++sock_it)
+    EventLoop loop(ClientPool::defaultCapacity());
+    loop.zygote_fd = worker.zygote_fd;
+    loop.error_pages = worker.error_pages;
+    std::vector<EventSource>& listeners = loop.listeners;
+    ClientPool& clients = loop.clients;
+
+    // Sized once: epoll keeps pointers to these
+    std::vector<const Server*> servers;
+    std::map<int, const VirtualHosts*>::iterator it;
+    for (it = worker.listeners.begin(); it != worker.listeners.end(); ++it)
+    {
+        EventSource listener;
+        listener.kind = EventSource::LISTENER;
+        listener.fd = it->first;
+        listener.hosts = it->second;
+        listeners.push_back(listener);
+        const std::vector<const Server*>& group = it->second->get_servers();
+        for (size_t i = 0; i < group.size(); ++i)
         {
-            servers[*sock_it] = *serv_it;
+            if (std::find(servers.begin(), servers.end(), group[i]) == servers.end())
+                servers.push_back(group[i]);
         }
     }
-    int epoll_fd = epoll_create1(0);
+    // The loop's open file cache is as large as its largest server asks for;
+    // servers with open_file_cache off bypass it
+    int cache_max = 0;
+    int cache_inactive = 0;
+    size_t static_cache_size = 0;
+    for (size_t i = 0; i < servers.size(); ++i)
+    {
+        cache_max = std::max(cache_max, servers[i]->get_open_file_cache_max());
+        cache_inactive = std::max(cache_inactive, servers[i]->get_open_file_cache_inactive());
+        static_cache_size = std::max(static_cache_size, servers[i]->get_static_cache_size());
+    }
+    loop.open_files.configure(cache_max, cache_inactive);
+    loop.static_files.configure(static_cache_size);
+    loop.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    int epoll_fd = loop.epoll_fd;
     if (epoll_fd == -1)
     {
         perror("epoll_create1");
+        fail_workers();
         return;
     }
-    std::map<int, Server>::iterator it;
-    for (it = servers.begin(); it != servers.end(); ++it)
+    for (size_t i = 0; i < listeners.size(); ++i)
     {
         struct epoll_event event;
         event.events = EPOLLIN;
-        event.data.fd = it->first;
-        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, it->first, &event) == -1)
+        event.data.ptr = &listeners[i];
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listeners[i].fd, &event) == -1)
         {
             perror("epoll_ctl: add server fd");
+            fail_workers();
+            close(epoll_fd);
+            return;
+        }
+    }
+    // Spawned scripts are picked up as the zygote's answers arrive
+    if (loop.zygote_fd != -1)
+    {
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = &loop.zygote;
+        loop.zygote.kind = EventSource::ZYGOTE;
+        loop.zygote.fd = loop.zygote_fd;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, loop.zygote_fd, &event) == -1)
+        {
+            perror("epoll_ctl: add zygote channel");
+            loop.zygote.fd = -1;
+            loop.zygote_fd = -1;
         }
-    }    struct epoll_event events[MAX_EVENTS];
-    int count;    while (!sigint_pressed)
+    }
+    struct epoll_event events[MAX_EVENTS];
+    int count;
+    while (!sigint_pressed && !workers_failed)
     {
         if (LOG)
         {
-            std::cout << "\n--epoll: listening... ("
-                      << servers.size() << " servers, "
-                      << clients.size() << " clients)\n";
+            std::cout << "\n--epoll[" << worker.id << "]: listening... ("
+                      << listeners.size() << " listeners, "
+                      << clients.size() << " clients, static cache "
+                      << loop.static_files.getHits() << " hits / "
+                      << loop.static_files.getMisses() << " misses)\n";
         }
-        count = epoll_wait(epoll_fd, events, MAX_EVENTS, POLL_TIMEOUT);
+        // Sleep until the next deadline; POLL_TIMEOUT bounds it so the loop
+        // still notices SIGINT and reaps CGI children
+        int timeout = loop.timers.nextTimeout(TimerWheel::now(), POLL_TIMEOUT);
+        count = epoll_wait(epoll_fd, events, MAX_EVENTS, timeout);
         if (count < 0)
         {
+            if (errno == EINTR)
+                continue;
             if (!sigint_pressed)
                 perror("epoll_wait");
             break;
         }
-        if (count == 0) {
-            // Check for timed out clients
-            check_client_timeouts(clients, epoll_fd);
-            continue;
-        }
-        process_epoll_events(epoll_fd, events, count, servers, clients);
+        if (count > 0)
+            process_epoll_events(loop, events, count);
+        // Deadlines are checked every iteration, busy or not
+        expire_timers(loop);
+        loop.open_files.expire(TimerWheel::now());
+        reap_cgi_zombies(loop);
+        // Connections closed during this iteration can be handed out again
+        clients.recycle();
     }
-    close_clients(clients);
+    close_clients(loop);
     close(epoll_fd);
-}
\ No newline at end of file
+    if (loop.static_files.isEnabled())
+    {
+        std::cout << "Worker " << worker.id << " static cache: "
+                  << loop.static_files.getHits() << " hits, "
+                  << loop.static_files.getMisses() << " misses, "
+                  << loop.static_files.getCount() << " files ("
+                  << loop.static_files.getUsed() << " bytes)" << std::endl;
+    }
+}
+
+// polling() only returns on shutdown or if its event loop could not be set
+// up, which stops every worker; either way the worker is done
+static void* worker_routine(void* arg)
+{
+    Worker* worker = static_cast<Worker*>(arg);
+    polling(*worker);
+    return NULL;
+}
+
+// Runs every worker's event loop: worker 0 on the calling thread, the rest on
+// their own threads. Configuration is shared read-only; each worker owns its
+// epoll instance, its clients and its SO_REUSEPORT listeners. Returns false
+// if a worker failed to start, once the others have stopped.
+bool run_workers(std::vector<Worker>& workers)
+{
+    // SIGINT is handled by the main thread; the other loops notice the flag
+    // within one POLL_TIMEOUT
+    sigset_t blocked, previous;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+    size_t started = 1;
+    for (; started < workers.size(); ++started)
+    {
+        int error = pthread_create(&workers[started].thread, NULL, worker_routine, &workers[started]);
+        if (error != 0)
+        {
+            std::cerr << "Could not start worker " << started << ": " << strerror(error) << std::endl;
+            fail_workers();
+            break;
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    if (!workers.empty() && !workers_failed)
+        worker_routine(&workers[0]);
+    for (size_t i = 1; i < started; ++i)
+        pthread_join(workers[i].thread, NULL);
+    return !workers_failed;
+}
@@ -3,13 +3,16 @@
 #include "../../include/signals.hpp"
 #include "../../include/Utils.hpp"
 #include "../../include/CGI.hpp"
+#include "../../include/CGIZygote.hpp"
 #include <fcntl.h>
 #include <sys/epoll.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <cstring>
+#include <strings.h>
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -18,11 +21,195 @@
 #include <ctime>
 
 #define BUFFER_SIZE 4096
-#define MAX_SEND_RETRIES 7
+#define SENDFILE_SLICE (512 * 1024) // Max file bytes sent per write readiness
 
 // Forward declarations
 void handle_file_upload(Client& client);
 void handle_json_upload(Client& client);
+static void feed_cgi_input(EventLoop& loop, Client& client);
+
+// Uploads to a location with basic auth need valid credentials
+static bool is_upload_authorized(const Request& request, const Location* location)
+{
+    if (!location)
+        return true;
+    if (location->get_auth_basic_realm().empty() || location->get_auth_basic_user_file().empty())
+        return true;
+    return Utils::validateBasicAuth(request.getHeader("authorization"));
+}
+
+// Answers from the loop's open file cache when the server enables it. The
+// result is only valid until the next lookup.
+static OpenFileCache::File lookup_file(EventLoop& loop, const Server& server, const std::string& path)
+{
+    if (server.get_open_file_cache_max() > 0)
+        return loop.open_files.lookup(path, server.get_open_file_cache_valid());
+    return loop.open_files.lookupUncached(path);
+}
+
+// The handler a request goes to
+enum Handler {
+    HANDLE_ERROR,           // the error page for route.status
+    HANDLE_HEADER_TOO_LARGE,
+    HANDLE_UNAUTHORIZED,
+    HANDLE_FILE_UPLOAD,
+    HANDLE_JSON_UPLOAD,
+    HANDLE_REDIRECT,
+    HANDLE_CGI,             // a script, or the location's FastCGI application
+    HANDLE_DIRECTORY,
+    HANDLE_DELETE,
+    HANDLE_STATIC
+};
+
+struct Route {
+    Handler handler;
+    int status;                 // HANDLE_ERROR only
+    const Config* scope;        // whose error pages answer: the location once there is one
+    const Location* location;
+    std::string path;           // the file the URI maps to, index appended for a directory
+    OpenFileCache::File file;
+};
+
+// Decides how a request is answered. handle_http_request() acts on the
+// result; append_client_data() asks as soon as the headers are in, so a
+// script can start before the body has arrived and read it as it comes.
+static void route_request(EventLoop& loop, const Server& server, const Request& request, Route& route)
+{
+    route.handler = HANDLE_ERROR;
+    route.status = HTTP_BAD_REQUEST;
+    route.scope = &server;
+    route.location = NULL;
+    route.path.clear();
+
+    if (request.hasError()) {
+        std::string error_type = request.getErrorType();
+        if (error_type == "ERROR_HEADER_TOO_LARGE") {
+            route.handler = HANDLE_HEADER_TOO_LARGE;
+            return;
+        }
+        if (error_type == "ERROR_REQUEST_ENTITY_TOO_LARGE")
+            route.status = HTTP_REQUEST_ENTITY_TOO_LARGE;
+        else if (error_type == "ERROR_BODY_STORAGE")
+            route.status = HTTP_INTERNAL_SERVER_ERROR;
+        if (error_type == "ERROR_REQUEST_ENTITY_TOO_LARGE" || error_type == "ERROR_BAD_REQUEST"
+            || error_type == "ERROR_BODY_STORAGE")
+            return;
+    }
+    
+    // Basic request validation
+    const std::string& method = request.getMethod();
+    if (method.empty() || request.getUri().empty())
+        return;
+    if (method != METHOD_GET && method != METHOD_POST && method != METHOD_DELETE) {
+        route.status = HTTP_METHOD_NOT_ALLOWED;
+        return;
+    }
+    
+    std::pair<bool, const Location*> location_pair = server.get_location(request.getUri());
+    const Location* location = location_pair.first ? location_pair.second : NULL;
+    route.location = location;
+    
+    // Uploads come first: they need credentials where the location asks for them
+    if (method == METHOD_POST) {
+        if (!is_upload_authorized(request, location)) {
+            route.handler = HANDLE_UNAUTHORIZED;
+            return;
+        }
+        std::string content_type = request.getHeader("content-type");
+        if (content_type.find("multipart/form-data") != std::string::npos) {
+            route.handler = HANDLE_FILE_UPLOAD;
+            return;
+        }
+        if (request.getUri() == "/upload" && content_type.find("application/json") != std::string::npos) {
+            route.handler = HANDLE_JSON_UPLOAD;
+            return;
+        }
+    }
+    
+    if (!location) {
+        route.status = HTTP_NOT_FOUND;
+        return;
+    }
+    route.scope = location;
+    if (location->get_return().code != -1) {
+        route.handler = HANDLE_REDIRECT;
+        return;
+    }
+    if (!location->get_methods().empty() && !location->has_method(method)) {
+        route.status = HTTP_METHOD_NOT_ALLOWED;
+        return;
+    }
+    
+    // Build file path using nginx-style path resolution: an alias replaces the
+    // location prefix (/images/photo.jpg -> /var/www/img/photo.jpg), a root gets
+    // the full URI appended (/var/www/images/photo.jpg)
+    route.path = location->mapPath(request.getUri());
+    
+    // Without cgi_extension a FastCGI application answers for the whole
+    // location, whether or not a file backs the URI
+    if (!location->getFastCGIPass().empty() && location->get_cgi_extensions().empty()) {
+        route.handler = HANDLE_CGI;
+        return;
+    }
+    
+    // Handle index files for directory requests
+    route.file = lookup_file(loop, server, route.path);
+    if (route.path[route.path.length() - 1] == '/' || route.file.isDirectory()) {
+        const std::vector<std::string>& indexes = location->get_indexes();
+        if (!indexes.empty()) {
+            if (route.path[route.path.length() - 1] != '/')
+                route.path += "/";
+            route.path += indexes[0];
+            route.file = lookup_file(loop, server, route.path);
+        }
+    }
+    
+    if (!route.file.exists)
+        route.status = HTTP_NOT_FOUND;
+    else if (route.file.isDirectory())
+        route.handler = HANDLE_DIRECTORY;
+    else if (method == METHOD_DELETE)
+        route.handler = HANDLE_DELETE;
+    else if (CGI::isCGIScript(route.path, location->get_cgi_extensions()))
+        route.handler = HANDLE_CGI;
+    else
+        route.handler = HANDLE_STATIC;
+}
+
+// Feeds received bytes to the client's request. Once the headers are in, the
+// body limits and spool settings come from the matching location, authorized
+// multipart uploads are streamed to the upload store as they arrive, and a
+// request for a script is answered right away so the body streams to it.
+static void append_client_data(EventLoop& loop, Client& client, const char* data, size_t length)
+{
+    client.appendData(data, length);
+    Request& request = client.getRequest();
+    if (!request.isAwaitingBody())
+        return;
+    
+    const Server& server = client.getServer();
+    std::pair<bool, const Location*> location_pair = server.get_location(request.getUri());
+    const Location* location = location_pair.first ? location_pair.second : NULL;
+    const Config* body_config = location ? static_cast<const Config*>(location) : &server;
+    request.setMaxBodySize(body_config->get_client_max_size());
+    request.setBodyBuffer(body_config->get_client_body_buffer_size(), body_config->get_client_body_temp_path());
+    
+    std::string content_type = request.getHeader("content-type");
+    if (request.getMethod() == METHOD_POST
+        && content_type.find("multipart/form-data") != std::string::npos
+        && is_upload_authorized(request, location)) {
+        std::string store = location ? location->getUploadStore() : UPLOAD_STORE_DEFAULT;
+        if (client.getUpload().begin(content_type, store, body_config->get_client_max_size()))
+            request.setBodyParser(&client.getUpload());
+    }
+    client.beginBody();
+    if (request.isComplete() || request.getMethod() != METHOD_POST)
+        return;
+    Route route;
+    route_request(loop, server, request, route);
+    if (route.handler == HANDLE_CGI)
+        client.setRequestReady(true);
+}
 
 void log_new_connection(int fd)
 {
@@ -39,17 +226,10 @@ void log_new_connection(int fd)
         std::cout << "new connection at fd: " << fd << "not found" << std::endl;
 }
 
-bool handle_connection_attempt(
-    int fd,
-    std::map<int, Server>& servers,
-    std::map<int, Client>& clients,
-    int epoll_fd
-)
+bool handle_connection_attempt(EventLoop& loop, EventSource& listener)
 {
-    // Make sure fd is actually one of our server sockets
-    std::map<int, Server>::iterator server_it = servers.find(fd);
-    if (server_it == servers.end())
-        return false;
+    int epoll_fd = loop.epoll_fd;
+    int fd = listener.fd;
 
     struct sockaddr_in client_addr;
     socklen_t client_len = sizeof(client_addr);
@@ -57,32 +237,36 @@ bool handle_connection_attempt(
     // Accept as many pending connections as possible (non-blocking)
     while (true)
     {
-        int client_fd = accept(fd, (struct sockaddr*)&client_addr, &client_len);
+        // non-blocking, and never inherited by a script
+        int client_fd = accept4(fd, (struct sockaddr*)&client_addr, &client_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
         if (client_fd == -1)
         {
             // No more connections available
             break;
         }
 
-        // make new client socket non-blocking
-        int flags = fcntl(client_fd, F_GETFL, 0);
-        fcntl(client_fd, F_SETFL, flags | O_NONBLOCK);
-
-        // create Client object and store it
-        Client new_client(client_fd, server_it->second);
-        clients.insert(std::make_pair(client_fd, new_client));
+        // take a recycled Client from the slab
+        Client* client = loop.clients.acquire(client_fd, *listener.hosts);
+        if (client == NULL)
+        {
+            std::cout << "Too many clients, refusing connection at fd: " << client_fd << std::endl;
+            close(client_fd);
+            continue;
+        }
 
-        // register client socket with epoll
+        // register client socket with epoll; EPOLLOUT is only enabled while output is queued
         struct epoll_event event;
-        event.events  = EPOLLIN | EPOLLOUT;
-        event.data.fd = client_fd;
+        event.events  = EPOLLIN;
+        event.data.ptr = &client->getSocketSource();
         if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_fd, &event) == -1)
         {
             perror("epoll_ctl: add client");
             close(client_fd);
-            clients.erase(client_fd);
+            loop.clients.release(*client);
             continue;
         }
+        client->setEpollEvents(EPOLLIN);
+        schedule_client_timeout(loop, *client);
 
         // log this connection
         log_new_connection(client_fd);
@@ -91,10 +275,125 @@ bool handle_connection_attempt(
     return true;
 }
 
-bool handle_client_data(int client_fd, Client& client, int epoll_fd)
+// Registers the running script's pipes with epoll, tagged with the owning client
+bool watch_cgi_pipes(EventLoop& loop, Client& client)
+{
+    CGI& cgi = client.getCGI();
+    EventSource* sources = client.getPipeSources();
+    int pipes[3] = { cgi.getStdinFd(), cgi.getStdoutFd(), cgi.getStderrFd() };
+    uint32_t pipe_events[3] = { EPOLLOUT, EPOLLIN, EPOLLIN };
+    // A FastCGI connection carries the request out and the response back
+    if (cgi.getBackendFd() != -1) {
+        pipes[1] = cgi.getBackendFd();
+        pipe_events[1] = EPOLLIN | EPOLLOUT;
+    }
+
+    for (int i = 0; i < 3; ++i)
+    {
+        if (pipes[i] == -1)
+            continue;
+        struct epoll_event event;
+        event.events = pipe_events[i];
+        event.data.ptr = &sources[i];
+        if (epoll_ctl(loop.epoll_fd, EPOLL_CTL_ADD, pipes[i], &event) == -1)
+        {
+            perror("epoll_ctl: add cgi pipe");
+            return false;
+        }
+        sources[i].fd = pipes[i];
+    }
+    return true;
+}
+
+void unwatch_cgi_pipe(EventLoop& loop, Client& client, int pipe_fd)
+{
+    if (pipe_fd == -1)
+        return;
+    EventSource* sources = client.getPipeSources();
+    for (int i = 0; i < 3; ++i)
+    {
+        if (sources[i].fd != pipe_fd)
+            continue;
+        epoll_ctl(loop.epoll_fd, EPOLL_CTL_DEL, pipe_fd, NULL);
+        sources[i].fd = -1;
+    }
+}
+
+// Writes the body received so far to the script's stdin. Only a full pipe is
+// watched for EPOLLOUT; one waiting for more of the body is written to when
+// the body grows.
+static void write_cgi_input(EventLoop& loop, Client& client)
+{
+    CGI& cgi = client.getCGI();
+    int stdin_fd = cgi.getStdinFd();
+    EventSource& source = client.getPipeSources()[0];
+    CGI::InputState state = cgi.writeInput();
+    if (state != CGI::INPUT_BLOCKED)
+    {
+        unwatch_cgi_pipe(loop, client, stdin_fd);
+        return;
+    }
+    if (source.fd != -1)
+        return;
+    struct epoll_event event;
+    event.events = EPOLLOUT;
+    event.data.ptr = &source;
+    if (epoll_ctl(loop.epoll_fd, EPOLL_CTL_ADD, stdin_fd, &event) == -1)
+    {
+        perror("epoll_ctl: add cgi stdin");
+        cgi.closeStdin(); // The script sees a truncated body rather than hanging
+        return;
+    }
+    source.fd = stdin_fd;
+}
+
+// Stops watching a script and kills it (timeouts, disconnects, errors)
+void abort_cgi(EventLoop& loop, Client& client)
+{
+    CGI& cgi = client.getCGI();
+    // Still spawning: the zygote's answer is dropped when it arrives
+    if (cgi.isSpawning())
+        std::replace(loop.zygote_waiting.begin(), loop.zygote_waiting.end(), &client, static_cast<Client*>(NULL));
+    unwatch_cgi_pipe(loop, client, cgi.getStdinFd());
+    unwatch_cgi_pipe(loop, client, cgi.getStdoutFd());
+    unwatch_cgi_pipe(loop, client, cgi.getStderrFd());
+    unwatch_cgi_pipe(loop, client, cgi.getBackendFd());
+    cgi.terminate();
+}
+
+// The location whose script the client's CGI runs; its error pages answer for it
+static const Config& cgi_scope(Client& client)
+{
+    const Server& server = client.getServer();
+    std::pair<bool, const Location*> location_pair = server.get_location(client.getRequest().getUri());
+    if (location_pair.first)
+        return *location_pair.second;
+    return server;
+}
+
+// Answers with the scope's precompiled error page
+static void send_error_page(EventLoop& loop, Response& response, const Config& scope, int code)
+{
+    StaticCache::Entry* page = loop.error_pages->acquire(scope, code);
+    response.sendError(code, *page);
+    page->release();
+}
+
+// Header bytes, or a finished response's body, still waiting for the socket
+static bool has_unsent_output(Client& client)
+{
+    if (client.hasPendingOutput())
+        return true;
+    if (!client.isResponseSent())
+        return false;
+    Response& response = client.getResponse();
+    return response.hasMemoryBody() || response.hasFileBody();
+}
+
+bool handle_client_data(EventLoop& loop, int client_fd, Client& client)
 {
     char buffer[BUFFER_SIZE];
-    ssize_t bytes_read = recv(client_fd, buffer, sizeof(buffer) - 1, 0);
+    ssize_t bytes_read = recv(client_fd, buffer, sizeof(buffer), 0);
     
     if (bytes_read <= 0) {
         // Client disconnected or error
@@ -105,34 +404,33 @@ bool handle_client_data(int client_fd, Client& client, int epoll_fd)
                 client.getResponse().sendClientClosedRequest();
                 std::cout << "Client closed connection during request processing" << std::endl;
             }
+            // Half-closed: still deliver what is queued, then close
+            if (has_unsent_output(client)) {
+                client.setKeepAlive(false);
+                update_client_events(loop, client_fd, client, EPOLLOUT);
+                return false;
+            }
         } else {
             std::cout << "Error reading from client " << std::endl;
         }
-        
-        // Remove from epoll and close
-        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client_fd, NULL);
-        close(client_fd);
-        return true; // Signal that client should be removed from map
-    }
-    
-    // Null-terminate the buffer
-    buffer[bytes_read] = '\0';
-    
-    // Set max body size on request if not already set
-    if (!client.getRequest().isComplete()) {
-        // Get the appropriate max body size limit
-        size_t max_body_size = client.getServer().get_client_max_size();
-        if (!client.getRequest().getUri().empty()) {
-            std::pair<bool, const Location*> location_pair = client.getServer().get_location(client.getRequest().getUri());
-            if (location_pair.first) {
-                max_body_size = location_pair.second->get_client_max_size();
-            }
-        }
-        client.getRequest().setMaxBodySize(max_body_size);
+        return true; // Signal that client should be closed and removed from map
     }
     
     // Append data to client
-    client.appendData(std::string(buffer, bytes_read));
+    append_client_data(loop, client, buffer, bytes_read);
+    
+    // A CGI script is already producing the response for this request: it
+    // gets the body bytes that just arrived, unless the body turned out bad
+    if (client.getCGI().isRunning()) {
+        if (!client.getRequest().hasError()) {
+            feed_cgi_input(loop, client);
+            return false;
+        }
+        abort_cgi(loop, client);
+        // Part of the script's response is out: it can only be cut short
+        if (client.isResponseStarted())
+            return true;
+    }
     
     // Check for request parsing errors after appending data
     if (client.getRequest().hasError()) {
@@ -145,379 +443,382 @@ bool handle_client_data(int client_fd, Client& client, int epoll_fd)
         }
     }
     
-    // If request is complete, handle it
-    if (client.isRequestReady() && !client.isResponseSent()) {
-        handle_http_request(client);
-        
-        // Send response with non-blocking approach
-        std::string response = client.getResponse().buildResponse(client.getRequest().getVersion());
-        ssize_t bytes_sent = send(client_fd, response.c_str(), response.length(), MSG_NOSIGNAL | MSG_DONTWAIT);
+    return process_requests(loop, client_fd, client);
+}
+
+// Answers every complete request buffered for the client, including pipelined ones.
+// Returns true once the connection should be closed.
+bool process_requests(EventLoop& loop, int client_fd, Client& client)
+{
+    while (client.isRequestReady() && !client.isResponseSent() && !client.getCGI().isRunning()) {
+        handle_http_request(loop, client);
         
-        if (bytes_sent > 0) {
-            // Reset retry counter on successful send
-            client.resetSendRetries();
-            if (bytes_sent == (ssize_t)response.length()) {
-                // Complete response sent
-                client.setResponseSent(true);
-                std::cout << "Complete response sent to client " << client_fd << std::endl;
-            } else {
-                // Partial send - in a real implementation, we'd buffer the remaining data
-                std::cout << "Partial response sent to client " << client_fd 
-                         << " (" << bytes_sent << "/" << response.length() << " bytes)" << std::endl;
-                client.setResponseSent(true); // For simplicity, mark as sent
+        // CGI requests finish asynchronously once the script's output hits EOF
+        if (client.getCGI().isRunning()) {
+            if (watch_cgi_pipes(loop, client)) {
+                schedule_client_timeout(loop, client);
+                return false;
             }
-        } else if (bytes_sent == -1) {
-            client.incrementSendRetries();
-            if (client.getSendRetries() > MAX_SEND_RETRIES) {
-                std::cout << "Max send retries exceeded for client " << client_fd << std::endl;
-                // Error occurred - max retries exceeded
-                client.setResponseSent(true); // Mark as sent to trigger cleanup
-            } else {
-                // Socket not ready for writing or temporary error, will try again on EPOLLOUT
-                std::cout << "Socket " << client_fd << " send failed, retry " << client.getSendRetries() << "/" << MAX_SEND_RETRIES << std::endl;
-                return false; // Don't close connection yet
-            }
-        } else {
-            // This shouldn't happen (bytes_sent should be > 0 or == -1)
-            std::cout << "Unexpected send result for client " << client_fd << std::endl;
-            client.setResponseSent(true); // Mark as sent to trigger cleanup
+            // Could not watch the pipes: answer with an error right away
+            abort_cgi(loop, client);
+            client.getResponse().sendError(HTTP_INTERNAL_SERVER_ERROR);
         }
         
-        // Close connection after sending response (HTTP/1.0 style)
-        if (client.isResponseSent()) {
-            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client_fd, NULL);
-            close(client_fd);
-            return true; // Signal that client should be removed from map
-        }
+        if (finish_response(loop, client_fd, client))
+            return true;
     }
     
     return false; // Client should remain in map
 }
 
-void handle_http_request(Client& client)
+// The Date header only changes once a second
+static const std::string& http_date(EventLoop& loop)
+{
+    time_t now = time(0);
+    if (now != loop.date_second) {
+        loop.date_header = Utils::formatHttpDate(now);
+        loop.date_second = now;
+    }
+    return loop.date_header;
+}
+
+// Serializes the response's headers into the client's output buffer
+static void start_response(EventLoop& loop, Client& client)
 {
-    Request& request = client.getRequest();
     Response& response = client.getResponse();
     const Server& server = client.getServer();
     
-    std::cout << "Handling request: " << request.getMethod() << " " << request.getUri() << std::endl;
+    bool keep_alive = client.shouldKeepAlive();
+    // A script answered before the body was in: what is left of it could not
+    // be told apart from the next request
+    if (!client.getRequest().isComplete())
+        keep_alive = false;
+    std::map<std::string, std::string>::const_iterator connection = response.getHeaders().find("Connection");
+    if (connection != response.getHeaders().end() && connection->second == "close")
+        keep_alive = false;
+    response.setHeader("Connection", keep_alive ? "keep-alive" : "close");
+    if (keep_alive)
+        response.setHeader("Keep-Alive", "timeout=" + Utils::toString(server.get_keepalive_timeout()));
+    
+    response.buildHeaders(client.getRequest().getVersion(), http_date(loop), client.getOutputBuffer());
+    client.setKeepAlive(keep_alive);
+    client.setResponseStarted(true);
+}
+
+// Completes the response and starts sending it, headers first unless a
+// streamed body already followed them out.
+// Returns true once the connection should be closed.
+bool finish_response(EventLoop& loop, int client_fd, Client& client)
+{
+    if (!client.isResponseStarted())
+        start_response(loop, client);
+    client.setResponseSent(true);
+    return flush_client_output(loop, client_fd, client);
+}
+
+// Changes the events epoll reports for a client socket, skipping no-op updates
+void update_client_events(EventLoop& loop, int client_fd, Client& client, uint32_t events)
+{
+    if (client.getEpollEvents() == events)
+        return;
+    struct epoll_event event;
+    event.events = events;
+    event.data.ptr = &client.getSocketSource();
+    if (epoll_ctl(loop.epoll_fd, EPOLL_CTL_MOD, client_fd, &event) == -1)
+        perror("epoll_ctl: mod client");
+    client.setEpollEvents(events);
+}
+
+// Writes the header block and any in-memory body with writev() as far as the
+// socket takes them, then streams a file-backed body with sendfile() one slice
+// per write readiness. EPOLLOUT stays enabled only
+// while bytes remain. Once the response is out the connection is either closed or
+// reset for the next request. Returns true once the connection should be closed.
+bool flush_client_output(EventLoop& loop, int client_fd, Client& client)
+{
+    Response& response = client.getResponse();
     
-    // Check for request parsing errors first
-    if (request.hasError()) {
-        std::string error_type = request.getErrorType();
-        if (error_type == "ERROR_HEADER_TOO_LARGE") {
-            response.sendRequestHeaderTooLarge();
-            return;
-        } else if (error_type == "ERROR_REQUEST_ENTITY_TOO_LARGE") {
-            ServerConfig config;
-            config.error_pages = server.get_error_pages();
-            response.sendError(HTTP_REQUEST_ENTITY_TOO_LARGE, config, server.get_root());
-            return;
-            // response.sendError(HTTP_REQUEST_ENTITY_TOO_LARGE, "Request entity too large");
-            // return;
+    while (has_unsent_output(client)) {
+        ssize_t bytes_sent;
+        if (client.hasPendingOutput() || response.hasMemoryBody()) {
+            // Header block and in-memory body leave together in one writev(),
+            // the body read in place from the response or the static cache
+            struct iovec parts[2];
+            int part_count = 0;
+            if (client.hasPendingOutput()) {
+                parts[part_count].iov_base = const_cast<char*>(client.getPendingOutput());
+                parts[part_count].iov_len = client.getPendingSize();
+                part_count++;
+            }
+            if (response.hasMemoryBody()) {
+                parts[part_count].iov_base = const_cast<char*>(response.getMemoryData());
+                parts[part_count].iov_len = response.getMemoryRemaining();
+                part_count++;
+            }
+            bytes_sent = writev(client_fd, parts, part_count);
+            if (bytes_sent > 0) {
+                size_t from_output = std::min(static_cast<size_t>(bytes_sent), client.getPendingSize());
+                if (from_output > 0)
+                    client.consumeOutput(from_output);
+                if (static_cast<size_t>(bytes_sent) > from_output)
+                    response.consumeMemoryBody(bytes_sent - from_output);
+                continue;
+            }
+        } else {
+            bytes_sent = response.sendFileBody(client_fd, SENDFILE_SLICE);
+            if (bytes_sent > 0) {
+                if (!response.hasFileBody())
+                    continue;
+                // Give other clients a turn; EPOLLOUT brings us back for the next slice
+                update_client_events(loop, client_fd, client, client.getEpollEvents() | EPOLLOUT);
+                return false;
+            }
+        }
+        if (bytes_sent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // Socket buffer full: resume on EPOLLOUT
+            update_client_events(loop, client_fd, client, client.getEpollEvents() | EPOLLOUT);
+            return false;
         }
+        std::cout << "Send to client " << client_fd << " failed" << std::endl;
+        return true;
     }
     
-    // Basic request validation
-    if (request.getMethod().empty() || request.getUri().empty()) {
-        ServerConfig config;
-        config.error_pages = server.get_error_pages();
-        response.sendError(HTTP_BAD_REQUEST, config, ".");
-        return;
+    update_client_events(loop, client_fd, client, client.getEpollEvents() & ~EPOLLOUT);
+    if (!client.isResponseSent())
+        return false;
+    std::cout << "Complete response sent to client " << client_fd << std::endl;
+    if (!client.isKeepAlive())
+        return true;
+    
+    // Same socket, next request: keep whatever the client already pipelined
+    std::string pipelined = client.getRequest().takePipelinedData();
+    client.reset();
+    if (!pipelined.empty())
+        append_client_data(loop, client, pipelined.data(), pipelined.size());
+    return false;
+}
+
+// True if the client's copy is current (RFC 7232): If-None-Match wins over
+// If-Modified-Since, ETags are compared weakly
+static bool is_not_modified(const Request& request, const struct stat& st)
+{
+    if (request.hasHeader("if-none-match")) {
+        std::string etag = Utils::makeETag(st);
+        std::vector<std::string> candidates = Utils::split(request.getHeader("if-none-match"), ',');
+        for (size_t i = 0; i < candidates.size(); ++i) {
+            std::string candidate = Utils::trim(candidates[i]);
+            if (candidate.compare(0, 2, "W/") == 0)
+                candidate = candidate.substr(2);
+            if (candidate == "*" || candidate == etag)
+                return true;
+        }
+        return false;
     }
-    
-    // Check if method is allowed
-    if (request.getMethod() != METHOD_GET && 
-        request.getMethod() != METHOD_POST && 
-        request.getMethod() != METHOD_DELETE) {
-        ServerConfig config;
-        config.error_pages = server.get_error_pages();
-        response.sendError(HTTP_METHOD_NOT_ALLOWED, config, ".");
+    time_t since;
+    if (request.hasHeader("if-modified-since")
+        && Utils::parseHttpDate(request.getHeader("if-modified-since"), since))
+        return st.st_mtime <= since;
+    return false;
+}
+
+// If-Range (RFC 7233): the range applies only while the client's validator,
+// a strong ETag or the exact Last-Modified date, still matches
+static bool is_range_current(const Request& request, const struct stat& st)
+{
+    if (!request.hasHeader("if-range"))
+        return true;
+    std::string validator = Utils::trim(request.getHeader("if-range"));
+    if (!validator.empty() && validator[0] == '"')
+        return validator == Utils::makeETag(st);
+    time_t date;
+    return Utils::parseHttpDate(validator, date) && date == st.st_mtime;
+}
+
+// Conditional GETs are answered with a bare 304 from the cached stat result
+// and Range requests with only the requested bytes. Small files come from the
+// loop's static cache when the server enables it, everything else from disk.
+static void serve_static_file(EventLoop& loop, const Server& server, const Location& location,
+    const Request& request, Response& response, const std::string& path, const OpenFileCache::File& file)
+{
+    bool zero_copy = location.get_sendfile();
+    if (file.readable && request.getMethod() == METHOD_GET && is_not_modified(request, file.st)) {
+        response.sendNotModified(file.st);
         return;
     }
-    
-    // Get location configuration early for POST requests
-    std::pair<bool, const Location*> location_pair = server.get_location(request.getUri());
-    const Location* location = location_pair.first ? location_pair.second : NULL;
-    
-    // Handle POST requests early for file uploads
-    if (request.getMethod() == METHOD_POST) {
-        // Check request body size against location or server configuration
-        // size_t request_body_size = request.getBody().length();
-        // size_t max_body_size = location ? location->get_client_max_size() : server.get_client_max_size();
-        
-        // if (request_body_size > max_body_size) {
-        //     std::cout << "Request body too large: " << request_body_size 
-        //               << " bytes (max: " << max_body_size << " bytes)" << std::endl;
-        //     response.sendError(HTTP_REQUEST_ENTITY_TOO_LARGE);
-        //     return;
-        // }
-        
-        // Check authentication for upload endpoints
-        if (location) {
-            const Location& upload_location = *location;
-            std::string auth_realm = upload_location.get_auth_basic_realm();
-            std::string auth_user_file = upload_location.get_auth_basic_user_file();
-            if (!auth_realm.empty() && !auth_user_file.empty())
-            {
-                std::string auth_header = request.getHeader("authorization");
-                if (!Utils::validateBasicAuth(auth_header))
-                {
-                    response.setStatus(HTTP_UNAUTHORIZED);
-                    response.setHeader("WWW-Authenticate", "Basic realm=\"" + auth_realm + "\"");
-                    response.setHeader("Content-Type", "text/html");
-                    response.setBody("<html><body><h1>401 Unauthorized</h1><p>Authentication required for upload.</p></body></html>");
-                    std::cout << "Authentication failed for upload: " << request.getUri() << std::endl;
-                    return;
-                }
-            }
-        }
-        
-        std::string content_type = request.getHeader("content-type");
-        if (content_type.find("multipart/form-data") != std::string::npos) {
-            handle_file_upload(client);
+    if (file.fd != -1 && request.getMethod() == METHOD_GET && request.hasHeader("range")
+        && is_range_current(request, file.st)) {
+        std::vector<Response::ByteRange> ranges;
+        Response::RangeStatus status = Response::parseRanges(request.getHeader("range"), file.st.st_size, ranges);
+        if (status == Response::RANGE_UNSATISFIABLE) {
+            send_error_page(loop, response, location, HTTP_RANGE_NOT_SATISFIABLE);
+            response.setHeader("Content-Range", "bytes */" + Utils::toString(static_cast<size_t>(file.st.st_size)));
             return;
         }
-        // Handle JSON POST requests to upload endpoint
-        if (request.getUri() == "/upload" && content_type.find("application/json") != std::string::npos) {
-            handle_json_upload(client);
+        if (status == Response::RANGE_SATISFIABLE) {
+            response.sendRanges(path, file, ranges, zero_copy);
             return;
         }
     }
-    
-    // Get location configuration if not already found
-    if (!location) {
-        location_pair = server.get_location(request.getUri());
-        location = location_pair.first ? location_pair.second : NULL;
-    }
-    
-    if (!location) {
-        ServerConfig config;
-        config.error_pages = server.get_error_pages();
-        response.sendError(HTTP_NOT_FOUND, config, ".");
-        return;
+    if (server.get_static_cache_size() > 0 && file.readable) {
+        StaticCache::Entry* entry = loop.static_files.lookup(path, file, server.get_static_cache_max_file());
+        if (entry) {
+            response.sendCached(*entry);
+            return;
+        }
     }
-    
-    const Location& location_ref = *location;
-    
-    // Handle HTTP redirection first (return directive)
-    Config::ReturnData return_data = location_ref.get_return();
-    if (return_data.code != -1) {
-        response.setStatus(return_data.code);
-        response.setHeader("Location", return_data.text);
-        response.setHeader("Content-Type", "text/html");
+    response.sendFile(path, file, zero_copy);
+}
 
-        std::ostringstream body;
-        body << "<html><body><h1>" << return_data.code << " ";
-        if (return_data.code == 301) body << "Moved Permanently";
-        else if (return_data.code == 302) body << "Found";
-        else body << "Redirect";
-        body << "</h1>";
-        body << "<p>The document has moved <a href=\"" << return_data.text << "\">here</a>.</p>";
-        body << "</body></html>";
-        
-        response.setBody(body.str());
-        std::cout << "Redirecting to: " << return_data.text << " with status " << return_data.code << std::endl;
+// Answers a return directive
+static void send_redirect(Response& response, const Config::ReturnData& return_data)
+{
+    response.setStatus(return_data.code);
+    response.setHeader("Location", return_data.text);
+    response.setHeader("Content-Type", "text/html");
+
+    std::ostringstream body;
+    body << "<html><body><h1>" << return_data.code << " ";
+    if (return_data.code == 301) body << "Moved Permanently";
+    else if (return_data.code == 302) body << "Found";
+    else body << "Redirect";
+    body << "</h1>";
+    body << "<p>The document has moved <a href=\"" << return_data.text << "\">here</a>.</p>";
+    body << "</body></html>";
+    
+    response.setBody(body.str());
+    std::cout << "Redirecting to: " << return_data.text << " with status " << return_data.code << std::endl;
+}
+
+// A directory without an index file: its listing with autoindex on, else the
+// first index that exists, else 403
+static void serve_directory(EventLoop& loop, const Server& server, const Location& location,
+                            const Request& request, Response& response, const std::string& path)
+{
+    if (location.get_autoindex()) {
+        response.sendDirectoryListing(path, request.getUri());
         return;
     }
-    
-    // Check if method is allowed for this location
-    std::vector<std::string> allowed_methods = location_ref.get_methods();
-    if (!allowed_methods.empty()) {
-        bool method_allowed = false;
-        for (std::vector<std::string>::const_iterator it = allowed_methods.begin();
-             it != allowed_methods.end(); ++it) {
-            if (*it == request.getMethod()) {
-                method_allowed = true;
-                break;
-            }
-        }
-        if (!method_allowed) {
-            ServerConfig config;
-            config.error_pages = server.get_error_pages();
-            response.sendError(HTTP_METHOD_NOT_ALLOWED, config, server.get_root());
+    const std::vector<std::string>& indexes = location.get_indexes();
+    for (std::vector<std::string>::const_iterator it = indexes.begin(); it != indexes.end(); ++it) {
+        std::string index_path = Utils::joinPath(path, *it);
+        OpenFileCache::File index_file = lookup_file(loop, server, index_path);
+        if (index_file.exists) {
+            serve_static_file(loop, server, location, request, response, index_path, index_file);
             return;
         }
     }
+    send_error_page(loop, response, location, HTTP_FORBIDDEN);
+}
+
+void handle_http_request(EventLoop& loop, Client& client)
+{
+    Request& request = client.getRequest();
+    Response& response = client.getResponse();
+    const Server& server = client.getServer();
     
-    // Check authentication if required (only for POST requests)
-    if (request.getMethod() == METHOD_POST) {
-        std::string auth_realm = location_ref.get_auth_basic_realm();
-        std::string auth_user_file = location_ref.get_auth_basic_user_file();
-        if (!auth_realm.empty() && !auth_user_file.empty()) {
-            std::string auth_header = request.getHeader("authorization");
-            if (!Utils::validateBasicAuth(auth_header)) {
-                response.setStatus(HTTP_UNAUTHORIZED);
-                response.setHeader("WWW-Authenticate", "Basic realm=\"" + auth_realm + "\"");
-                response.setHeader("Content-Type", "text/html");
-                response.setBody("<html><body><h1>401 Unauthorized</h1><p>Authentication required.</p></body></html>");
-                std::cout << "Authentication failed for " << request.getUri() << std::endl;
-                return;
-            }
-            std::cout << "Authentication successful for " << request.getUri() << std::endl;
-        }
-    }
-    
-    // Build file path using nginx-style path resolution
-    std::string file_path;
-    std::string uri_path = request.getUri();
-    std::string location_route = location_ref.getRoute();
-    std::string location_root = location_ref.get_root();
-    std::string location_alias = location_ref.getAlias();
-    
-    // Nginx-style path resolution
-    if (!location_alias.empty()) {
-        // ALIAS directive: replace location prefix with alias path
-        // Example: location /images { alias /var/www/img; }
-        // Request: /images/photo.jpg -> /var/www/img/photo.jpg
-        if (uri_path.find(location_route) == 0) {
-            std::string remaining_path = uri_path.substr(location_route.length());
-            // Ensure no double slashes
-            if (location_alias[location_alias.length() - 1] == '/' && !remaining_path.empty() && remaining_path[0] == '/')
-            {
-                file_path = location_alias + remaining_path.substr(1);
-            } else if (location_alias[location_alias.length() - 1] != '/' && !remaining_path.empty() && remaining_path[0] != '/') {
-                file_path = location_alias + "/" + remaining_path;
-            } else {
-                file_path = location_alias + remaining_path;
-            }
-        } else {
-            file_path = location_alias;
-        }
-    } else {
-        // ROOT directive: append full URI path to root
-        // Example: root /var/www; location /images {}
-        // Request: /images/photo.jpg -> /var/www/images/photo.jpg
-        if (location_root[location_root.length() - 1] == '/' && uri_path[0] == '/') {
-            file_path = location_root + uri_path.substr(1);
-        } else if (location_root[location_root.length() - 1] != '/' && uri_path[0] != '/') {
-            file_path = location_root + "/" + uri_path;
-        } else {
-            file_path = location_root + uri_path;
-        }
-    }
+    std::cout << "Handling request: " << request.getMethod() << " " << request.getUri() << std::endl;
     
-    // Handle index files for directory requests
-    if (file_path[file_path.length() - 1] == '/' || Utils::isDirectory(file_path)) {
-        std::vector<std::string> indexes = location_ref.get_indexes();
-        if (!indexes.empty()) {
-            if (file_path[file_path.length() - 1] != '/') {
-                file_path += "/";
-            }
-            file_path += indexes[0];
-        }
+    Route route;
+    route_request(loop, server, request, route);
+    if (route.location && !route.path.empty()) {
+        const Location& location = *route.location;
+        std::cout << "LOG: Route: '" << location.getRoute() << "', URI: '" << request.getUri() << "', File path: '" << route.path << "'" << std::endl;
+        std::cout << "LOG: Location root: '" << location.get_root() << "', Location alias: '" << location.getAlias() << "'" << std::endl;
     }
     
-    std::cout << "LOG: Route: '" << location_route << "', URI: '" << uri_path << "', File path: '" << file_path << "'" << std::endl;
-    std::cout << "LOG: Location root: '" << location_root << "', Location alias: '" << location_alias << "'" << std::endl;
-    
-    // Check if file exists
-    if (!Utils::fileExists(file_path)) {
-        ServerConfig config;
-        config.error_pages = server.get_error_pages();
-        response.sendError(HTTP_NOT_FOUND, config, location_root);
+    switch (route.handler) {
+    case HANDLE_ERROR:
+        send_error_page(loop, response, *route.scope, route.status);
         return;
-    }
-    
-    // Handle directory listing
-    if (Utils::isDirectory(file_path)) {
-        if (location_ref.get_autoindex()) {
-            response.sendDirectoryListing(file_path, request.getUri());
-        } else {
-            // Try to serve index file
-            std::vector<std::string> indexes = location_ref.get_indexes();
-            bool index_found = false;
-            for (std::vector<std::string>::const_iterator it = indexes.begin(); it != indexes.end(); ++it) {
-                std::string index_path = Utils::joinPath(file_path, *it);
-                if (Utils::fileExists(index_path)) {
-                    response.sendFile(index_path);
-                    index_found = true;
-                    break;
-                }
-            }
-            if (!index_found) {
-                ServerConfig config;
-                config.error_pages = server.get_error_pages();
-                response.sendError(HTTP_FORBIDDEN, config, location_root);
-            }
-        }
+    case HANDLE_HEADER_TOO_LARGE:
+        response.sendRequestHeaderTooLarge();
         return;
-    }
-    
-    // Handle DELETE method
-    if (request.getMethod() == METHOD_DELETE) {
-        if (Utils::fileExists(file_path) && !Utils::isDirectory(file_path)) {
-            if (remove(file_path.c_str()) == 0) {
-                response.setStatus(HTTP_NO_CONTENT);
-                response.setHeader("Content-Type", "text/plain");
-                response.setBody("File deleted successfully");
-                std::cout << "Deleted file: " << file_path << std::endl;
-            } else {
-                ServerConfig config;
-                config.error_pages = server.get_error_pages();
-                response.sendError(HTTP_FORBIDDEN, config, server.get_root());
-                std::cout << "Failed to delete file: " << file_path << std::endl;
-            }
+    case HANDLE_UNAUTHORIZED:
+        response.setStatus(HTTP_UNAUTHORIZED);
+        response.setHeader("WWW-Authenticate", "Basic realm=\"" + route.location->get_auth_basic_realm() + "\"");
+        response.setHeader("Content-Type", "text/html");
+        response.setBody("<html><body><h1>401 Unauthorized</h1><p>Authentication required for upload.</p></body></html>");
+        std::cout << "Authentication failed for upload: " << request.getUri() << std::endl;
+        return;
+    case HANDLE_FILE_UPLOAD:
+        handle_file_upload(client);
+        return;
+    case HANDLE_JSON_UPLOAD:
+        handle_json_upload(client);
+        return;
+    case HANDLE_REDIRECT:
+        send_redirect(response, route.location->get_return());
+        return;
+    case HANDLE_CGI:
+        handle_cgi_request(loop, client, route.path, *route.location);
+        return;
+    case HANDLE_DIRECTORY:
+        serve_directory(loop, server, *route.location, request, response, route.path);
+        return;
+    case HANDLE_DELETE:
+        if (remove(route.path.c_str()) == 0) {
+            loop.open_files.invalidate(route.path);
+            response.setStatus(HTTP_NO_CONTENT);
+            response.setHeader("Content-Type", "text/plain");
+            response.setBody("File deleted successfully");
+            std::cout << "Deleted file: " << route.path << std::endl;
         } else {
-            ServerConfig config;
-            config.error_pages = server.get_error_pages();
-            response.sendError(HTTP_NOT_FOUND, config, server.get_root());
-            std::cout << "File not found for deletion: " << file_path << std::endl;
+            send_error_page(loop, response, *route.location, HTTP_FORBIDDEN);
+            std::cout << "Failed to delete file: " << route.path << std::endl;
         }
         return;
-    }
-    
-    // Check if it's a CGI script
-    std::map<std::string, std::string> cgi_extensions = location_ref.get_cgi_extensions();
-    if (CGI::isCGIScript(file_path, cgi_extensions)) {
-        handle_cgi_request(client, file_path, location_ref, server);
+    case HANDLE_STATIC:
+        serve_static_file(loop, server, *route.location, request, response, route.path, route.file);
         return;
     }
-    
-    // Serve static file
-    response.sendFile(file_path);
 }
 
-void handle_cgi_request(Client& client, const std::string& script_path, const Location& location, const Server& server)
+void handle_cgi_request(EventLoop& loop, Client& client, const std::string& script_path, const Location& location)
 {
     Request& request = client.getRequest();
     Response& response = client.getResponse();
     
-    CGI cgi;
+    CGI& cgi = client.getCGI();
     cgi.setScriptPath(script_path);
     cgi.setRequest(request);
     cgi.setDocumentRoot(location.getAlias());
     cgi.setServerInfo("localhost", "8080");
+    cgi.setRunDeadline(TimerWheel::now() + CGI::CGI_RUN_TIMEOUT * 1000UL);
+    
+    // A persistent application answers instead of a new process
+    const std::string& fastcgi_pass = location.getFastCGIPass();
+    if (!fastcgi_pass.empty()) {
+        int backend_fd = loop.fastcgi.acquire(fastcgi_pass);
+        if (backend_fd == -1) {
+            std::cout << "FastCGI backend " << fastcgi_pass << " unreachable" << std::endl;
+            send_error_page(loop, response, location, HTTP_BAD_GATEWAY);
+            return;
+        }
+        cgi.startFastCGI(fastcgi_pass, backend_fd);
+        return;
+    }
     
     // Get interpreter for this script type
     std::string ext = Utils::getExtension(script_path);
-    std::map<std::string, std::string> cgi_extensions = location.get_cgi_extensions();
+    const std::map<std::string, std::string>& cgi_extensions = location.get_cgi_extensions();
     std::map<std::string, std::string>::const_iterator it = cgi_extensions.find(ext);
     if (it != cgi_extensions.end()) {
         cgi.setInterpreter(it->second);
     }
     
-    // Execute CGI script
-    std::string cgi_output = cgi.execute();
-    
-    if (cgi_output == "timeout"){
-        ServerConfig config;
-        config.error_pages = server.get_error_pages();
-        response.sendError(HTTP_GATEWAY_TIMEOUT, config, server.get_root());
+    // Start the script; the epoll loop collects its output and finishes the response
+    if (!cgi.start(loop.zygote_fd)) {
+        send_error_page(loop, response, location, HTTP_INTERNAL_SERVER_ERROR);
         return;
     }
+    if (cgi.isSpawning())
+        loop.zygote_waiting.push_back(&client);
+}
 
-    if (cgi_output.empty()) {
-        ServerConfig config;
-        config.error_pages = server.get_error_pages();
-        response.sendError(HTTP_INTERNAL_SERVER_ERROR, config, server.get_root());
-        return;
-    }
-    
-    // Check for error responses (status codes >= 400)
-    std::string headers = cgi.getHeaders();
-    std::string body = cgi.getBody();
-    
+// Copies the script's header block into the response: Status sets the
+// status code, the other headers are passed through
+static void apply_cgi_headers(Response& response, const std::string& headers)
+{
     // Parse status from headers if present
     int status_code = HTTP_OK;
     if (headers.find("Status:") != std::string::npos) {
@@ -566,6 +867,13 @@ void handle_cgi_request(Client& client, const std::string& script_path, const Lo
                 header_value.erase(header_value.length() - 1);
             }
             
+            // Framing is the server's business: hop-by-hop headers are dropped
+            if (strcasecmp(header_name.c_str(), "Transfer-Encoding") == 0
+                || strcasecmp(header_name.c_str(), "Connection") == 0
+                || strcasecmp(header_name.c_str(), "Keep-Alive") == 0)
+                continue;
+            if (strcasecmp(header_name.c_str(), "Content-Length") == 0)
+                header_name = "Content-Length";
             response.setHeader(header_name, header_value);
             
             if (header_name == "Content-Type") {
@@ -578,117 +886,107 @@ void handle_cgi_request(Client& client, const std::string& script_path, const Lo
     if (!content_type_set) {
         response.setHeader("Content-Type", "text/html");
     }
-    
-    // Set response body
-    response.setBody(body);
 }
 
-void handle_file_upload(Client& client)
+// 1xx, 204 and 304 responses never have a body, whatever the script wrote
+static bool may_have_body(int status_code)
+{
+    return status_code >= 200 && status_code != HTTP_NO_CONTENT && status_code != HTTP_NOT_MODIFIED;
+}
+
+// Sends the status line and headers as soon as the script's header block is
+// in. Without a Content-Length from the script the body is chunked, or ends
+// with the connection for an HTTP/1.0 client.
+static void start_cgi_response(EventLoop& loop, Client& client)
 {
-    Request& request = client.getRequest();
     Response& response = client.getResponse();
-    
-    std::string content_type = request.getHeader("content-type");
-    std::string body = request.getBody();
-    
-    // Extract boundary from content-type
-    size_t boundary_pos = content_type.find("boundary=");
-    if (boundary_pos == std::string::npos) {
-        response.sendError(HTTP_BAD_REQUEST, "Missing boundary in multipart data");
-        return;
+    apply_cgi_headers(response, client.getCGI().getHeaders());
+    const std::map<std::string, std::string>& headers = response.getHeaders();
+    if (may_have_body(response.getStatusCode()) && headers.find("Content-Length") == headers.end()) {
+        if (client.getRequest().getVersion() == "HTTP/1.0")
+            response.setHeader("Connection", "close");
+        else
+            response.setHeader("Transfer-Encoding", "chunked");
     }
-    
-    std::string boundary = "--" + content_type.substr(boundary_pos + 9);
-    
-    // Simple multipart parsing
-    size_t start_pos = body.find(boundary);
-    if (start_pos == std::string::npos) {
-        response.sendError(HTTP_BAD_REQUEST, "Invalid multipart data");
+    start_response(loop, client);
+}
+
+// Moves the body bytes the script produced into the client's output buffer,
+// as one chunk when the response is chunked
+static void append_cgi_body(Client& client)
+{
+    std::string body;
+    client.getCGI().takeOutput(body);
+    Response& response = client.getResponse();
+    if (body.empty() || !may_have_body(response.getStatusCode()))
         return;
-    }
-    
-    // Find content-disposition header
-    size_t headers_start = start_pos + boundary.length();
-    size_t headers_end = body.find("\r\n\r\n", headers_start);
-    if (headers_end == std::string::npos) {
-        headers_end = body.find("\n\n", headers_start);
-        if (headers_end == std::string::npos) {
-            response.sendError(HTTP_BAD_REQUEST, "Invalid multipart headers");
-            return;
-        }
-        headers_end += 2;
+    std::string& out = client.getOutputBuffer();
+    if (response.getHeaders().count("Transfer-Encoding")) {
+        std::ostringstream chunk_size;
+        chunk_size << std::hex << body.size() << "\r\n";
+        out += chunk_size.str();
+        out += body;
+        out += "\r\n";
     } else {
-        headers_end += 4;
+        out += body;
     }
-    
-    std::string headers = body.substr(headers_start, headers_end - headers_start);
-    
-    // Extract filename
-    std::string filename;
-    size_t filename_pos = headers.find("filename=\"");
-    if (filename_pos != std::string::npos) {
-        filename_pos += 10; // length of "filename=\""
-        size_t filename_end = headers.find("\"", filename_pos);
-        if (filename_end != std::string::npos) {
-            filename = headers.substr(filename_pos, filename_end - filename_pos);
-        }
-    }
-    
-    if (filename.empty()) {
-        response.sendError(HTTP_BAD_REQUEST, "No filename provided");
+}
+
+// Completes the response once the script's output ended: the rest of a
+// streamed body, or the whole response if the script finished before its
+// headers went out
+void finish_cgi_request(EventLoop& loop, Client& client)
+{
+    Response& response = client.getResponse();
+    CGI& cgi = client.getCGI();
+    
+    if (client.isResponseStarted()) {
+        append_cgi_body(client);
+        if (response.getHeaders().count("Transfer-Encoding"))
+            client.getOutputBuffer() += "0\r\n\r\n";
+        // Less than the script's Content-Length: only closing ends the body
+        if (cgi.isBodyShort())
+            client.setKeepAlive(false);
         return;
     }
     
-    // Security: validate filename
-    if (filename.find("..") != std::string::npos || filename.find("/") != std::string::npos) {
-        response.sendError(HTTP_BAD_REQUEST, "Invalid filename");
+    if (!cgi.finish()) {
+        send_error_page(loop, response, cgi_scope(client), HTTP_INTERNAL_SERVER_ERROR);
         return;
     }
+    apply_cgi_headers(response, cgi.getHeaders());
+    std::string body;
+    cgi.takeOutput(body);
+    response.setBody(body);
+}
+
+// The parts were written to the upload store while the body arrived; this
+// only reports the outcome
+void handle_file_upload(Client& client)
+{
+    Response& response = client.getResponse();
+    const MultipartParser& upload = client.getUpload();
     
-    // Find file content
-    size_t content_start = headers_end;
-    size_t content_end = body.find(boundary, content_start);
-    if (content_end == std::string::npos) {
-        response.sendError(HTTP_BAD_REQUEST, "Invalid multipart data end");
+    if (!upload.isActive()) {
+        response.sendError(HTTP_BAD_REQUEST, "Missing boundary in multipart data");
         return;
     }
-    
-    // Remove trailing \r\n before boundary
-    if (content_end >= 2 && body.substr(content_end - 2, 2) == "\r\n") {
-        content_end -= 2;
-    } else if (content_end >= 1 && body.substr(content_end - 1, 1) == "\n") {
-        content_end -= 1;
+    if (upload.hasFailed()) {
+        std::cout << "Upload failed: " << upload.getErrorMessage() << std::endl;
+        response.sendError(upload.getErrorCode(), upload.getErrorMessage());
+        return;
     }
-    
-    std::string file_content = body.substr(content_start, content_end - content_start);
-    
-    // Get location-specific body size limit
-    const Server& server = client.getServer();
-    std::pair<bool, const Location*> upload_location_pair = server.get_location(client.getRequest().getUri());
-    size_t max_file_size = upload_location_pair.first ? 
-        upload_location_pair.second->get_client_max_size() : 
-        server.get_client_max_size();
-    
-    // Check file size against limits
-    size_t file_size = file_content.length();
-    if (file_size > max_file_size) {
-        std::cout << "File too large: " << file_size 
-                  << " bytes (max: " << max_file_size << " bytes)" << std::endl;
-        response.sendError(HTTP_REQUEST_ENTITY_TOO_LARGE, "File size exceeds configured limit");
+    if (!upload.isComplete()) {
+        response.sendError(HTTP_BAD_REQUEST, "Invalid multipart data end");
         return;
     }
     
-    // Save file to uploads directory
-    std::string upload_path = "www/uploads/" + filename;
-    std::ofstream outfile(upload_path.c_str(), std::ios::binary);
-    if (!outfile.is_open()) {
-        response.sendError(HTTP_INTERNAL_SERVER_ERROR, "Failed to create upload file");
+    const std::vector<MultipartParser::SavedFile>& files = upload.getFiles();
+    if (files.empty()) {
+        response.sendError(HTTP_BAD_REQUEST, "No filename provided");
         return;
     }
     
-    outfile.write(file_content.c_str(), file_content.length());
-    outfile.close();
-    
     // Send success response
     response.setStatus(HTTP_CREATED);
     response.setHeader("Content-Type", "text/html");
@@ -698,15 +996,16 @@ void handle_file_upload(Client& client)
     success_body << "<html><head><title>Upload Success</title></head>\n";
     success_body << "<body>\n";
     success_body << "<h1>File Upload Successful</h1>\n";
-    success_body << "<p>File <strong>" << filename << "</strong> has been uploaded successfully.</p>\n";
-    success_body << "<p>File size: " << file_content.length() << " bytes</p>\n";
+    for (size_t i = 0; i < files.size(); ++i) {
+        success_body << "<p>File <strong>" << files[i].name << "</strong> has been uploaded successfully.</p>\n";
+        success_body << "<p>File size: " << files[i].size << " bytes</p>\n";
+        std::cout << "File uploaded successfully: " << files[i].name << " (" << files[i].size << " bytes)" << std::endl;
+    }
     success_body << "<p><a href=\"/uploads\">View uploaded files</a></p>\n";
     success_body << "<p><a href=\"/upload\">Upload another file</a></p>\n";
     success_body << "</body></html>\n";
     
     response.setBody(success_body.str());
-    
-    std::cout << "File uploaded successfully: " << filename << " (" << file_content.length() << " bytes)" << std::endl;
 }
 
 void handle_json_upload(Client& client)
@@ -714,7 +1013,7 @@ void handle_json_upload(Client& client)
     Request& request = client.getRequest();
     Response& response = client.getResponse();
     
-    std::string body = request.getBody();
+    std::string body = request.getBody().str();
     
     // Validate JSON content
     if (body.empty()) {
@@ -740,68 +1039,397 @@ void handle_json_upload(Client& client)
     std::cout << "JSON POST request processed successfully for /upload endpoint" << std::endl;
 }
 
-void close_clients(std::map<int, Client>& clients)
+// Sends the response a script or its timeout produced and moves on to the
+// next request, or closes the connection
+static void resume_client(EventLoop& loop, Client& client)
+{
+    int client_fd = client.getFd();
+    if (finish_response(loop, client_fd, client) || process_requests(loop, client_fd, client))
+        close_client(loop, client);
+    else if (!client.getCGI().isRunning())
+        schedule_client_timeout(loop, client);
+}
+
+// Ends a script's response with an error: the error page if nothing has been
+// sent yet, otherwise by closing the connection, which cuts a streamed body
+// short
+static void fail_cgi_response(EventLoop& loop, Client& client, int code)
 {
-    std::map<int, Client>::iterator it;
-    for (it = clients.begin(); it != clients.end(); ++it) {
-        close(it->first);
+    if (client.isResponseStarted()) {
+        close_client(loop, client);
+        return;
     }
+    send_error_page(loop, client.getResponse(), cgi_scope(client), code);
+    resume_client(loop, client);
 }
 
-void check_client_timeouts(std::map<int, Client>& clients, int epoll_fd)
+// Passes the script's output on as it is read. Once the client has a
+// buffer's worth queued the output is left unread until the socket drains
+// (watch_cgi_output()), so memory does not grow with the response.
+static void relay_cgi_output(EventLoop& loop, Client& client)
 {
-    std::vector<int> timed_out_clients;
-    
-    for (std::map<int, Client>::iterator it = clients.begin(); it != clients.end(); ++it)
+    CGI& cgi = client.getCGI();
+    if (!client.isResponseStarted()) {
+        if (cgi.getHeaderState() == CGI::HEADERS_PENDING)
+            return;
+        if (cgi.getHeaderState() == CGI::HEADERS_INVALID) {
+            abort_cgi(loop, client);
+            fail_cgi_response(loop, client, HTTP_INTERNAL_SERVER_ERROR);
+            return;
+        }
+        start_cgi_response(loop, client);
+    }
+    append_cgi_body(client);
+    if (flush_client_output(loop, client.getFd(), client)) {
+        close_client(loop, client);
+        return;
+    }
+    if (client.getPendingSize() >= CGI_OUTPUT_BUFFER_SIZE)
+        unwatch_cgi_pipe(loop, client, client.getPipeSources()[1].fd);
+    // A script streaming its response is making progress, up to its run deadline
+    schedule_client_timeout(loop, client);
+}
+
+// Lets a script paused by relay_cgi_output() write again once the client has
+// taken most of what was queued
+static void watch_cgi_output(EventLoop& loop, Client& client)
+{
+    CGI& cgi = client.getCGI();
+    EventSource& source = client.getPipeSources()[1];
+    int output_fd = (cgi.getBackendFd() != -1) ? cgi.getBackendFd() : cgi.getStdoutFd();
+    if (source.fd != -1 || output_fd == -1 || client.getPendingSize() >= CGI_OUTPUT_BUFFER_SIZE / 2)
+        return;
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    if (cgi.getBackendFd() != -1 && cgi.isWritingBackend())
+        event.events |= EPOLLOUT;
+    event.data.ptr = &source;
+    if (epoll_ctl(loop.epoll_fd, EPOLL_CTL_ADD, output_fd, &event) == -1) {
+        perror("epoll_ctl: resume cgi output");
+        return;
+    }
+    source.fd = output_fd;
+}
+
+// Writes the request to the application as far as the socket and the body
+// received so far allow. Returns false if the connection failed.
+static bool write_fastcgi_input(EventLoop& loop, Client& client)
+{
+    CGI& cgi = client.getCGI();
+    CGI::InputState state = cgi.writeBackend();
+    if (state == CGI::INPUT_FAILED)
+        return false;
+    // Paused for a slow client: watch_cgi_output() sets the events on resume
+    if (client.getPipeSources()[1].fd == -1)
+        return true;
+    // Only a full socket needs EPOLLOUT; the response is read either way
+    struct epoll_event event;
+    event.events = (state == CGI::INPUT_BLOCKED) ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+    event.data.ptr = &client.getPipeSources()[1];
+    epoll_ctl(loop.epoll_fd, EPOLL_CTL_MOD, cgi.getBackendFd(), &event);
+    return true;
+}
+
+// Completes the response once the application ended the request, or fails it
+// with a 502 if the connection broke first
+static void end_fastcgi_request(EventLoop& loop, Client& client)
+{
+    CGI& cgi = client.getCGI();
+    unwatch_cgi_pipe(loop, client, cgi.getBackendFd());
+    if (cgi.hasBackendEnded())
+    {
+        if (cgi.isBackendReusable())
+            loop.fastcgi.release(cgi.getBackendAddress(), cgi.detachBackend());
+        cgi.closeBackend();
+        std::cout << "FastCGI request finished for client " << client.getFd() << std::endl;
+        finish_cgi_request(loop, client);
+        resume_client(loop, client);
+        return;
+    }
+    cgi.closeBackend();
+    std::cout << "FastCGI backend " << cgi.getBackendAddress() << " failed" << std::endl;
+    fail_cgi_response(loop, client, HTTP_BAD_GATEWAY);
+}
+
+// Handles readiness on a FastCGI connection: the request is written while the
+// socket takes it and the records coming back are collected until the
+// application ends the request
+static void handle_fastcgi_event(EventLoop& loop, Client& client, uint32_t revents)
+{
+    CGI& cgi = client.getCGI();
+
+    bool failed = false;
+    if (cgi.isWritingBackend() && (revents & (EPOLLOUT | EPOLLERR)))
+        failed = !write_fastcgi_input(loop, client);
+    ssize_t bytes_read = -1;
+    if (!failed && (revents & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+    {
+        while (cgi.getOutput().size() < CGI_OUTPUT_BUFFER_SIZE && (bytes_read = cgi.readBackend()) > 0)
+            ;
+    }
+    if (failed || bytes_read == 0)
+        end_fastcgi_request(loop, client);
+    else if (!cgi.getOutput().empty())
+        relay_cgi_output(loop, client);
+}
+
+// Passes body bytes that just arrived to the script already answering the
+// request. A stdin pipe that is watched is written once it drains instead.
+static void feed_cgi_input(EventLoop& loop, Client& client)
+{
+    CGI& cgi = client.getCGI();
+    if (cgi.getBackendFd() != -1)
+    {
+        if (cgi.isWritingBackend() && !write_fastcgi_input(loop, client))
+            end_fastcgi_request(loop, client);
+        return;
+    }
+    if (client.getPipeSources()[0].fd == -1)
+        write_cgi_input(loop, client);
+}
+
+// Handles readiness on one of a running script's pipes
+void handle_cgi_event(EventLoop& loop, EventSource& source, uint32_t revents)
+{
+    int pipe_fd = source.fd;
+    Client& client = *source.client;
+    int client_fd = client.getFd();
+    CGI& cgi = client.getCGI();
+
+    if (pipe_fd == cgi.getBackendFd())
+    {
+        handle_fastcgi_event(loop, client, revents);
+        return;
+    }
+
+    if (pipe_fd == cgi.getStdinFd())
     {
-        if (it->second.isTimedOut(CLIENT_TIMEOUT))
+        // A reader that went away (EPOLLERR) fails the write and closes stdin
+        write_cgi_input(loop, client);
+        return;
+    }
+    if (pipe_fd == cgi.getStderrFd())
+    {
+        if (cgi.readErrors() == 0)
         {
-            std::cout << "Client " << it->first << " timed out" << std::endl;
-            
-            // Send timeout response if request was in progress
-            if (!it->second.getRequest().isComplete() && !it->second.getRequest().getMethod().empty())
-            {
-                it->second.getResponse().sendRequestTimeout();
-            }
-            
-            timed_out_clients.push_back(it->first);
+            unwatch_cgi_pipe(loop, client, pipe_fd);
+            cgi.closeStderr();
         }
+        return;
     }
-    
-    // Clean up timed out clients
-    for (std::vector<int>::iterator fd_it = timed_out_clients.begin(); 
-         fd_it != timed_out_clients.end(); ++fd_it)
+    if (pipe_fd != cgi.getStdoutFd())
+        return;
+
+    // Read up to a buffer's worth; a result of 0 means the script closed stdout
+    ssize_t bytes_read = -1;
+    while (cgi.getOutput().size() < CGI_OUTPUT_BUFFER_SIZE && (bytes_read = cgi.readOutput()) > 0)
+        ;
+    if (bytes_read != 0)
+    {
+        if (!cgi.getOutput().empty())
+            relay_cgi_output(loop, client);
+        return;
+    }
+
+    unwatch_cgi_pipe(loop, client, cgi.getStdinFd());
+    unwatch_cgi_pipe(loop, client, cgi.getStdoutFd());
+    unwatch_cgi_pipe(loop, client, cgi.getStderrFd());
+    cgi.closeStdin();
+    cgi.closeStdout();
+    cgi.closeStderr();
+    if (!cgi.reap())
+        loop.cgi_zombies.push_back(cgi.getPid());
+
+    std::cout << "CGI finished for client " << client_fd << std::endl;
+    finish_cgi_request(loop, client);
+    resume_client(loop, client);
+}
+
+// Hands a client the script the zygote spawned for it (child <= 0 without
+// one: the script is spawned here instead) and starts watching its pipes
+static void adopt_spawned_cgi(EventLoop& loop, Client& client, pid_t child, const int fds[4])
+{
+    if (client.getCGI().adoptSpawned(child, fds) && watch_cgi_pipes(loop, client))
+        return;
+    abort_cgi(loop, client);
+    fail_cgi_response(loop, client, HTTP_INTERNAL_SERVER_ERROR);
+}
+
+// Collects the zygote's answers, which come in the order of the requests. An
+// answer for a client that went away meanwhile kills the script it started.
+// Once the zygote is gone the scripts still waiting are spawned here, as are
+// all later ones.
+void handle_zygote_event(EventLoop& loop)
+{
+    pid_t child;
+    int fds[4];
+    int answered;
+    while ((answered = CGIZygote::receive(loop.zygote_fd, child, fds)) > 0)
+    {
+        Client* client = NULL;
+        if (!loop.zygote_waiting.empty())
+        {
+            client = loop.zygote_waiting.front();
+            loop.zygote_waiting.pop_front();
+        }
+        if (client)
+        {
+            adopt_spawned_cgi(loop, *client, child, fds);
+            continue;
+        }
+        if (child <= 0)
+            continue;
+        CGIZygote::kill(fds[3], SIGKILL);
+        for (int i = 0; i < 4; ++i)
+            close(fds[i]);
+    }
+    if (answered == 0)
+        return;
+
+    std::cout << "CGI zygote gone, scripts are forked by the worker" << std::endl;
+    epoll_ctl(loop.epoll_fd, EPOLL_CTL_DEL, loop.zygote_fd, NULL);
+    loop.zygote.fd = -1;
+    loop.zygote_fd = -1;
+    while (!loop.zygote_waiting.empty())
+    {
+        Client* client = loop.zygote_waiting.front();
+        loop.zygote_waiting.pop_front();
+        if (client)
+            adopt_spawned_cgi(loop, *client, -1, fds);
+    }
+}
+
+// Unregisters and closes a client, killing any script still working for it.
+// The slot goes back to the slab once the current event batch is done.
+void close_client(EventLoop& loop, Client& client)
+{
+    if (!client.isOpen())
+        return;
+    if (client.getCGI().isRunning())
+        abort_cgi(loop, client);
+    epoll_ctl(loop.epoll_fd, EPOLL_CTL_DEL, client.getFd(), NULL);
+    close(client.getFd());
+    loop.clients.release(client);
+}
+
+void close_clients(EventLoop& loop)
+{
+    for (size_t slot = 0; slot < loop.clients.getCapacity(); ++slot)
+        close_client(loop, loop.clients.at(slot));
+    loop.clients.recycle();
+}
+
+// Arms the client's timer for what it is waiting on now: its script, the next
+// request on an idle persistent connection, or progress on the current exchange
+void schedule_client_timeout(EventLoop& loop, Client& client)
+{
+    const CGI& cgi = client.getCGI();
+    int timeout = CLIENT_TIMEOUT;
+    if (cgi.isRunning())
+        timeout = CGI::CGI_TIMEOUT;
+    else if (client.isKeepAliveIdle())
+        timeout = client.getServer().get_keepalive_timeout();
+    unsigned long deadline = TimerWheel::now() + timeout * 1000UL;
+    // Progress postpones the idle deadline, never the end of the script's run
+    if (cgi.isRunning())
+        deadline = std::min(deadline, cgi.getRunDeadline());
+    loop.timers.arm(client.getTimer(), deadline);
+}
+
+// Handles every client whose deadline passed since the last loop iteration
+void expire_timers(EventLoop& loop)
+{
+    std::vector<void*> fired;
+    loop.timers.expire(TimerWheel::now(), fired);
+
+    for (std::vector<void*>::iterator it = fired.begin(); it != fired.end(); ++it)
+    {
+        Client& client = *static_cast<Client*>(*it);
+        if (!client.isOpen())
+            continue;
+        int client_fd = client.getFd();
+
+        if (client.getCGI().isRunning())
+        {
+            std::cout << "CGI for client " << client_fd << " timed out" << std::endl;
+            abort_cgi(loop, client);
+            fail_cgi_response(loop, client, HTTP_GATEWAY_TIMEOUT);
+            continue;
+        }
+
+        std::cout << "Client " << client_fd << " timed out" << std::endl;
+        // Send timeout response if request was in progress
+        if (!client.getRequest().isComplete() && !client.getRequest().getMethod().empty())
+            client.getResponse().sendRequestTimeout();
+        close_client(loop, client);
+    }
+}
+
+// Collects CGI children that had not exited yet when their output ended
+void reap_cgi_zombies(EventLoop& loop)
+{
+    std::vector<pid_t>::iterator it = loop.cgi_zombies.begin();
+    while (it != loop.cgi_zombies.end())
     {
-        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, *fd_it, NULL);
-        close(*fd_it);
-        clients.erase(*fd_it);
+        if (waitpid(*it, NULL, WNOHANG) != 0)
+            it = loop.cgi_zombies.erase(it);
+        else
+            ++it;
     }
 }
 
-void process_epoll_events(int epoll_fd, struct epoll_event* events, int active_fds,
-                                 std::map<int, Server>& servers,
-                                 std::map<int, Client>& clients)
+void process_epoll_events(EventLoop& loop, struct epoll_event* events, int active_fds)
 {
     for (int i = 0; i < active_fds; ++i)
     {
-        int fd = events[i].data.fd;
+        EventSource& source = *static_cast<EventSource*>(events[i].data.ptr);
         uint32_t revents = events[i].events;
         
-        if (revents & EPOLLIN || revents & EPOLLHUP )
+        if (source.kind == EventSource::LISTENER) {
+            // Server socket - handle new connections
+            if (revents & EPOLLIN)
+                handle_connection_attempt(loop, source);
+            continue;
+        }
+        if (source.kind == EventSource::ZYGOTE) {
+            if (source.fd != -1)
+                handle_zygote_event(loop);
+            continue;
+        }
+        // Closed earlier in this batch: the slot is not reused before the batch ends
+        if (source.fd == -1 || !source.client->isOpen())
+            continue;
+        if (source.kind == EventSource::CGI_PIPE)
         {
-            if (servers.find(fd) != servers.end()) {
-                // Server socket - handle new connections
-                handle_connection_attempt(fd, servers, clients, epoll_fd);
-            } else {
-                // Client socket - handle data
-                std::map<int, Client>::iterator client_it = clients.find(fd);
-                if (client_it != clients.end()) {
-                    bool should_remove = handle_client_data(fd, client_it->second, epoll_fd);
-                    if (should_remove || client_it->second.isResponseSent()) {
-                        clients.erase(client_it);
-                    }
-                }
+            handle_cgi_event(loop, source, revents);
+            continue;
+        }
+        // Client socket
+        int fd = source.fd;
+        Client& client = *source.client;
+        if (revents & EPOLLERR) {
+            close_client(loop, client);
+            continue;
+        }
+        if (revents & EPOLLOUT) {
+            // Drain queued output, then answer anything pipelined meanwhile
+            if (flush_client_output(loop, fd, client)
+                || process_requests(loop, fd, client)) {
+                close_client(loop, client);
+                continue;
             }
+            watch_cgi_output(loop, client);
         }
+        if (revents & (EPOLLIN | EPOLLHUP)) {
+            if (handle_client_data(loop, fd, client)) {
+                close_client(loop, client);
+                continue;
+            }
+        }
+        // Progress pushes the deadline back; a running script keeps its own
+        // unless it is still receiving the body or sending the response
+        if (client.isOpen() && (!client.getCGI().isRunning() || !client.getRequest().isComplete()
+                                || client.isResponseStarted()))
+            schedule_client_timeout(loop, client);
     }
-} 
\ No newline at end of file
+}
@@ -3,25 +3,77 @@
 
 int Client::client_count = 1;
 
-Client::Client(int fd, Server& server)
-	: id(client_count++), socket_fd(fd), server(server), 
-	  request_ready(false), response_sent(false), send_retry_count(0)
+// Clients live in a ClientPool and are recycled: open() and release() start
+// and end a connection on the same object
+Client::Client()
+	: id(0), socket_fd(-1), hosts(NULL), server(NULL), host_selected(false),
+	  request_ready(false), response_started(false), response_sent(false), requests_served(0),
+	  out_offset(0), keep_alive(false), epoll_events(0)
 {
-	last_activity = time(NULL);
+	timer.setOwner(this);
+	socket_source.kind = EventSource::CLIENT;
+	socket_source.client = this;
+	for (int i = 0; i < 3; ++i)
+	{
+		pipe_sources[i].kind = EventSource::CGI_PIPE;
+		pipe_sources[i].client = this;
+	}
 }
 
 Client::~Client()
 {
 }
 
+void Client::open(int fd, const VirtualHosts& vhosts)
+{
+	id = __sync_fetch_and_add(&client_count, 1);
+	socket_fd = fd;
+	hosts = &vhosts;
+	server = &vhosts.get_default();
+	host_selected = false;
+	requests_served = 0;
+	epoll_events = 0;
+	socket_source.fd = fd;
+}
+
+// Drops everything the connection held so the slot can be reused
+void Client::release()
+{
+	timer.cancel();
+	request = Request();
+	response = Response();
+	cgi = CGI();
+	upload.reset();
+	std::string().swap(out_buffer);
+	out_offset = 0;
+	request_ready = false;
+	response_started = false;
+	response_sent = false;
+	keep_alive = false;
+	epoll_events = 0;
+	socket_fd = -1;
+	hosts = NULL;
+	server = NULL;
+	host_selected = false;
+	socket_source.fd = -1;
+	for (int i = 0; i < 3; ++i)
+		pipe_sources[i].fd = -1;
+}
+
+bool Client::isOpen() const
+{
+	return socket_fd != -1;
+}
+
 std::string Client::toString() const
 {
 	std::ostringstream oss;
 	oss << "[ CLIENT ] ID: " << id << "\n"
 		<< "\t- Socket FD: " << socket_fd << "\n"
-		<< "\t- Server: " << server.get_server_name() << "\n"
+		<< "\t- Server: " << (server ? server->get_server_name() : "-") << "\n"
 		<< "\t- Request Ready: " << (request_ready ? "yes" : "no") << "\n"
-		<< "\t- Response Sent: " << (response_sent ? "yes" : "no") << "\n";
+		<< "\t- Response Sent: " << (response_sent ? "yes" : "no") << "\n"
+		<< "\t- Requests Served: " << requests_served << "\n";
 	return oss.str();
 }
 
@@ -37,7 +89,7 @@ int Client::getFd() const
 
 const Server& Client::getServer() const 
 { 
-	return server; 
+	return *server; 
 }
 
 Request& Client::getRequest() 
@@ -50,11 +102,26 @@ Response& Client::getResponse()
 	return response; 
 }
 
+CGI& Client::getCGI() 
+{ 
+	return cgi; 
+}
+
+MultipartParser& Client::getUpload()
+{
+	return upload;
+}
+
 bool Client::isRequestReady() const 
 { 
 	return request_ready; 
 }
 
+bool Client::isResponseStarted() const
+{
+	return response_started;
+}
+
 bool Client::isResponseSent() const 
 { 
 	return response_sent; 
@@ -65,56 +132,134 @@ void Client::setRequestReady(bool ready)
 	request_ready = ready; 
 }
 
+void Client::setResponseStarted(bool started)
+{
+	response_started = started;
+}
+
 void Client::setResponseSent(bool sent) 
 { 
 	response_sent = sent; 
 }
 
-void Client::appendData(const std::string& data)
+void Client::appendData(const char* data, size_t length)
+{
+	request.appendData(data, length);
+	if (!host_selected && request.hasHeaders())
+	{
+		// Each request on the connection names its own host
+		server = &hosts->select(request.getHeader("host"));
+		host_selected = true;
+	}
+	request_ready = request.isComplete();
+}
+
+void Client::beginBody()
 {
-	buffer += data;
-	request.appendData(data);
+	request.beginBody();
 	request_ready = request.isComplete();
-	updateLastActivity();
 }
 
+// Called between requests on a persistent connection
 void Client::reset()
 {
+	requests_served++;
 	request.reset();
 	response.reset();
-	buffer.clear();
+	cgi = CGI();
+	upload.reset();
 	request_ready = false;
+	response_started = false;
 	response_sent = false;
-	send_retry_count = 0;
-	last_activity = time(NULL);
+	out_buffer.clear();
+	out_offset = 0;
+	keep_alive = false;
+	host_selected = false;
+}
+
+bool Client::shouldKeepAlive() const
+{
+	if (request.hasError() || !request.isKeepAlive())
+		return false;
+	if (server->get_keepalive_timeout() <= 0)
+		return false;
+	return requests_served + 1 < server->get_keepalive_requests();
+}
+
+// Connection waiting for its next request after at least one response
+bool Client::isKeepAliveIdle() const
+{
+	return requests_served > 0 && !request.hasData();
+}
+
+TimerNode& Client::getTimer()
+{
+	return timer;
+}
+
+EventSource& Client::getSocketSource()
+{
+	return socket_source;
 }
 
-void Client::updateLastActivity()
+EventSource* Client::getPipeSources()
 {
-	last_activity = time(NULL);
+	return pipe_sources;
 }
 
-time_t Client::getLastActivity() const
+// Buffer the next header block is serialized into; it keeps its capacity
+// from one response to the next
+std::string& Client::getOutputBuffer()
 {
-	return last_activity;
+	if (out_offset == out_buffer.size())
+	{
+		out_buffer.clear();
+		out_offset = 0;
+	}
+	return out_buffer;
 }
 
-bool Client::isTimedOut(int timeout_seconds) const
+bool Client::hasPendingOutput() const
 {
-	return (time(NULL) - last_activity) > timeout_seconds;
+	return out_offset < out_buffer.size();
 }
 
-void Client::incrementSendRetries()
+const char* Client::getPendingOutput() const
 {
-	send_retry_count++;
+	return out_buffer.data() + out_offset;
 }
 
-int Client::getSendRetries() const
+size_t Client::getPendingSize() const
 {
-	return send_retry_count;
+	return out_buffer.size() - out_offset;
 }
 
-void Client::resetSendRetries()
+void Client::consumeOutput(size_t bytes)
 {
-	send_retry_count = 0;
-}
\ No newline at end of file
+	out_offset += bytes;
+	if (out_offset >= out_buffer.size())
+	{
+		out_buffer.clear();
+		out_offset = 0;
+	}
+}
+
+bool Client::isKeepAlive() const
+{
+	return keep_alive;
+}
+
+void Client::setKeepAlive(bool keep)
+{
+	keep_alive = keep;
+}
+
+uint32_t Client::getEpollEvents() const
+{
+	return epoll_events;
+}
+
+void Client::setEpollEvents(uint32_t events)
+{
+	epoll_events = events;
+}
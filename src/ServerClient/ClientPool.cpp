@@ -0,0 +1,71 @@
+#include "../../include/ClientPool.hpp"
+#include "../../include/webserv.hpp"
+#include <sys/resource.h>
+
+ClientPool::ClientPool(size_t capacity)
+	: slots(new Client[capacity]), capacity(capacity), in_use(0)
+{
+	free_slots.reserve(capacity);
+	released.reserve(capacity);
+	// Hand out low slots first so a lightly loaded loop touches little memory
+	for (size_t i = capacity; i > 0; --i)
+		free_slots.push_back(&slots[i - 1]);
+}
+
+ClientPool::~ClientPool()
+{
+	delete[] slots;
+}
+
+Client* ClientPool::acquire(int fd, const VirtualHosts& hosts)
+{
+	if (free_slots.empty())
+		return NULL;
+	Client* client = free_slots.back();
+	free_slots.pop_back();
+	client->open(fd, hosts);
+	in_use++;
+	return client;
+}
+
+// The caller has already closed the socket; the slot waits for recycle()
+void ClientPool::release(Client& client)
+{
+	if (!client.isOpen())
+		return;
+	client.release();
+	released.push_back(&client);
+	in_use--;
+}
+
+void ClientPool::recycle()
+{
+	free_slots.insert(free_slots.end(), released.begin(), released.end());
+	released.clear();
+}
+
+size_t ClientPool::size() const
+{
+	return in_use;
+}
+
+size_t ClientPool::getCapacity() const
+{
+	return capacity;
+}
+
+Client& ClientPool::at(size_t slot)
+{
+	return slots[slot];
+}
+
+// MAX_CLIENTS per loop, fewer if the process may not open that many fds
+size_t ClientPool::defaultCapacity()
+{
+	size_t capacity = MAX_CLIENTS;
+	struct rlimit limit;
+	if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY
+		&& limit.rlim_cur < capacity)
+		capacity = limit.rlim_cur;
+	return capacity;
+}
@@ -0,0 +1,91 @@
+#include "../../include/LocationTrie.hpp"
+#include "../../include/Location.hpp"
+
+LocationTrie::Node::Node() : prefix(NULL), exact(NULL)
+{
+}
+
+int	LocationTrie::Node::child( char c ) const
+{
+	for (size_t i = 0; i < children.size(); i++)
+	{
+		if (children[i].first == c)
+			return children[i].second;
+	}
+	return -1;
+}
+
+LocationTrie::LocationTrie()
+{
+	clear();
+}
+
+LocationTrie::LocationTrie( LocationTrie const& other )
+{
+	(void)other;
+	clear();
+}
+
+LocationTrie&	LocationTrie::operator=( LocationTrie const& other )
+{
+	(void)other;
+	clear();
+	return *this;
+}
+
+LocationTrie::~LocationTrie()
+{
+}
+
+void	LocationTrie::clear()
+{
+	_nodes.clear();
+	_nodes.push_back(Node());
+}
+
+void	LocationTrie::insert( Location const& location )
+{
+	std::string const& route = location.getRoute();
+	int node = 0;
+	for (size_t i = 0; i < route.length(); i++)
+	{
+		int next = _nodes[node].child(route[i]);
+		if (next == -1)
+		{
+			next = _nodes.size();
+			_nodes[node].children.push_back(std::make_pair(route[i], next));
+			_nodes.push_back(Node()); // Invalidates references into _nodes, hence indexes
+		}
+		node = next;
+	}
+	if (location.getMatch() == Location::MATCH_EXACT)
+		_nodes[node].exact = &location;
+	else
+		_nodes[node].prefix = &location;
+}
+
+// A prefix route matches when the URI continues with a new segment or ends
+// there: /upload matches /upload and /upload/a, but not /uploads
+const Location*	LocationTrie::match( std::string const& uri ) const
+{
+	const Location* best = NULL;
+	int node = 0;
+	size_t i = 0;
+	while (true)
+	{
+		const Node& current = _nodes[node];
+		if (current.prefix && (i == uri.length() || uri[i] == '/' || (i > 0 && uri[i - 1] == '/')))
+			best = current.prefix;
+		if (i == uri.length())
+		{
+			if (current.exact)
+				return current.exact;
+			break;
+		}
+		node = current.child(uri[i]);
+		if (node == -1)
+			break;
+		i++;
+	}
+	return best;
+}
@@ -1,10 +1,10 @@
 #include "../../include/Location.hpp"
 
-Location::Location() : Config(), route(""), alias(ALIAS_DEFAULT)
+Location::Location() : Config(), route(""), match(MATCH_PREFIX), alias(ALIAS_DEFAULT), upload_store(UPLOAD_STORE_DEFAULT)
 {
 }
 
-Location::Location(const std::string& route) : Config(), route(route), alias(ALIAS_DEFAULT)
+Location::Location(const std::string& route) : Config(), route(route), match(MATCH_PREFIX), alias(ALIAS_DEFAULT), upload_store(UPLOAD_STORE_DEFAULT)
 {
 }
 
@@ -14,8 +14,16 @@ Location::~Location()
 
 std::string Location::toString() const
 {
-	std::string result = "\t[ LOCATION ] " + route + "\n";
+	std::string result = "\t[ LOCATION ] ";
+	if (match == MATCH_EXACT)
+		result += "= ";
+	else if (match == MATCH_PREFIX_PRIORITY)
+		result += "^~ ";
+	result += route + "\n";
 	result += "\t\t· Alias: \"" + alias + "\"\n";
+	result += "\t\t· Upload store: \"" + upload_store + "\"\n";
+	if (!fastcgi_pass.empty())
+		result += "\t\t· FastCGI pass: \"" + fastcgi_pass + "\"\n";
 	result += static_cast<const Config&>(*this).printCfg("\t");
 	return result;
 }
@@ -35,6 +43,16 @@ void Location::setRoute(const std::string& route)
 	this->route = route; 
 }
 
+Location::Match Location::getMatch() const
+{
+	return match;
+}
+
+void Location::setMatch(Match match)
+{
+	this->match = match;
+}
+
 const std::string& Location::getAlias() const 
 { 
 	return alias; 
@@ -45,6 +63,51 @@ void Location::setAlias(const std::string& alias)
 	this->alias = alias; 
 }
 
+const std::string& Location::getUploadStore() const 
+{ 
+	return upload_store; 
+}
+
+void Location::setUploadStore(const std::string& upload_store) 
+{ 
+	this->upload_store = upload_store; 
+}
+
+const std::string& Location::getFastCGIPass() const
+{
+	return fastcgi_pass;
+}
+
+void Location::setFastCGIPass(const std::string& fastcgi_pass)
+{
+	this->fastcgi_pass = fastcgi_pass;
+}
+
+// File system path of uri: with an alias the route is replaced by it, otherwise
+// the whole uri is appended to the root (nginx semantics)
+std::string Location::mapPath(const std::string& uri) const
+{
+	size_t start = 0;
+	if (!alias.empty())
+	{
+		if (uri.compare(0, route.length(), route) != 0 || uri.length() == route.length())
+			return alias;
+		start = route.length();
+	}
+	std::string path = path_prefix;
+	if (uri[start] != '/')
+		path += '/';
+	path.append(uri, start, std::string::npos);
+	return path;
+}
+
+void Location::compile()
+{
+	path_prefix = alias.empty() ? _root : alias;
+	if (!path_prefix.empty() && path_prefix[path_prefix.length() - 1] == '/')
+		path_prefix.erase(path_prefix.length() - 1);
+}
+
 void Location::inherit(const Config& src)
 {
 	std::string path = (_inicializated[ROOT_INDEX] ? _root : src.get_root());
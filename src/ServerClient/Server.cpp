@@ -1,25 +1,21 @@
 #include "../../include/Server.hpp"
+#include "../../include/Utils.hpp"
 #include <sstream>
 #include <algorithm>
 
-#include <cerrno>
-#include <cstdio>
-#include <cstdlib>
-#include <sstream>
-#include <cstring>
-#include <unistd.h>
-#include <fcntl.h>
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <arpa/inet.h>
-
 int Server::num_servers = 0;
 
 Server::Server( void ) : Config(),
-	_active(false),
-	_ip(IP_DEFAULT)
+	_ip(IP_DEFAULT),
+	_default_server(false),
+	_keepalive_timeout(KEEPALIVE_TIMEOUT_DEFAULT),
+	_keepalive_requests(KEEPALIVE_REQUESTS_DEFAULT),
+	_worker_threads(WORKER_THREADS_DEFAULT),
+	_open_file_cache_max(OPEN_FILE_CACHE_MAX_DEFAULT),
+	_open_file_cache_inactive(OPEN_FILE_CACHE_INACTIVE_DEFAULT),
+	_open_file_cache_valid(OPEN_FILE_CACHE_VALID_DEFAULT),
+	_static_cache_size(STATIC_CACHE_SIZE_DEFAULT),
+	_static_cache_max_file(STATIC_CACHE_MAX_FILE_DEFAULT)
 {
 	//set server name
 	std::stringstream	ss;
@@ -27,27 +23,24 @@ Server::Server( void ) : Config(),
 	_server_name = "Server " + ss.str();
 
 	_ports.push_back(-1);
-	_sockets.clear();
 	_locations.clear();
 }
 
 // operator overloading
 Server::~Server( void )
 {
-	_active = false;
 	_locations.clear();
 }
 
 // getters setters
 
-int	Server::is_active() const { return _active; }
 
 //IPs
-std::string	Server::get_ip() const { return _ip; }
+std::string const&	Server::get_ip() const { return _ip; }
 void		Server::set_ip( std::string ip ) { _ip = ip; }
 
 //Ports
-std::vector<int>	Server::get_ports() const { return _ports; }
+std::vector<int> const&	Server::get_ports() const { return _ports; }
 void	Server::add_port( int port )
 {
 	if (_ports.size() == 1 && _ports.at(0) == -1)
@@ -61,42 +54,60 @@ bool	Server::has_port( int port )
 }
 
 //Server Names
-std::string	Server::get_server_name() const { return _server_name; }
+std::string const&	Server::get_server_name() const { return _server_name; }
 void		Server::set_server_name( std::string server_name ) { _server_name = server_name; }
-
-// Sockets
-std::vector<int>	Server::get_sockets() const { return _sockets; }
-bool				Server::has_socket( int sock ) const
+std::vector<std::string> const&	Server::get_server_names() const { return _server_names; }
+void		Server::add_server_name( std::string const& server_name )
 {
-	return std::find(_sockets.begin(), _sockets.end(), sock) != _sockets.end();
+	std::string name = Utils::toLower(server_name);
+	if (_server_names.empty())
+		_server_name = name;
+	if (std::find(_server_names.begin(), _server_names.end(), name) == _server_names.end())
+		_server_names.push_back(name);
 }
+bool		Server::is_default_server() const { return _default_server; }
+void		Server::set_default_server( bool is_default ) { _default_server = is_default; }
+
+//Keep-alive
+int		Server::get_keepalive_timeout() const { return _keepalive_timeout; }
+void	Server::set_keepalive_timeout( int seconds ) { _keepalive_timeout = seconds; }
+int		Server::get_keepalive_requests() const { return _keepalive_requests; }
+void	Server::set_keepalive_requests( int requests ) { _keepalive_requests = requests; }
+
+//Workers
+int		Server::get_worker_threads() const { return _worker_threads; }
+void	Server::set_worker_threads( int threads ) { _worker_threads = threads; }
+int		Server::get_open_file_cache_max() const { return _open_file_cache_max; }
+void	Server::set_open_file_cache_max( int entries ) { _open_file_cache_max = entries; }
+int		Server::get_open_file_cache_inactive() const { return _open_file_cache_inactive; }
+void	Server::set_open_file_cache_inactive( int seconds ) { _open_file_cache_inactive = seconds; }
+int		Server::get_open_file_cache_valid() const { return _open_file_cache_valid; }
+void	Server::set_open_file_cache_valid( int seconds ) { _open_file_cache_valid = seconds; }
+size_t	Server::get_static_cache_size() const { return _static_cache_size; }
+void	Server::set_static_cache_size( size_t bytes ) { _static_cache_size = bytes; }
+size_t	Server::get_static_cache_max_file() const { return _static_cache_max_file; }
+void	Server::set_static_cache_max_file( size_t bytes ) { _static_cache_max_file = bytes; }
 
 // Locations
-std::map<std::string, Location>	Server::get_locations() const { return _locations; }
-std::pair<bool, Location const*>	Server::get_location( std::string route ) const
+std::map<std::string, Location> const&	Server::get_locations() const { return _locations; }
+// The exact location for route, else its longest prefix location
+std::pair<bool, Location const*>	Server::get_location( std::string const& route ) const
 {
-	std::map<std::string, Location>::const_iterator it;
-	int index;
+	Location const* location = _location_trie.match(route);
+	return std::pair<bool, Location const*>(location != NULL, location);
+}
 
-	// check if route exists in locations
-	std::string last;
-	while (1)
+// Precomputes what the request path derives from each location once the
+// configuration is complete; nothing is modified after this. The location
+// trie points into this object, so a copy has to be compiled again.
+void	Server::compile()
+{
+	_location_trie.clear();
+	for (std::map<std::string, Location>::iterator it = _locations.begin(); it != _locations.end(); it++)
 	{
-		it = _locations.find(route);
-		if (it != _locations.end())
-			return std::pair<bool, Location const*>(true, &(it->second));
-
-		index = route.rfind("/");
-		last = route.substr(0, index);
-		if (last.empty())
-			last = "/";
-		if (last == route)
-			break ;
-		route = last;
-	};
-
-	//location not found
-	return std::pair<bool, Location const*>(false, NULL);
+		it->second.compile();
+		_location_trie.insert(it->second);
+	}
 }
 
 void	Server::add_location( std::string route, Location location )
@@ -108,64 +119,6 @@ void	Server::add_location( std::string route, Location location )
 	}
 }
 
-// class functions
-
-void	Server::run()
-{
-	if (_active) 	// Check if the server is already running
-		return ;
-	_active = true;
-	for (std::vector<int>::iterator it = _ports.begin(); it != _ports.end(); it++) 	// Create all the ports connections
-	{
-		int port = *it;
-		if (port < 0 || port > 65535)
-			throw RuntimeException("Invalid port");
-		int socket_fd = socket(AF_INET, SOCK_STREAM, 0); 	// open socket
-		if (socket_fd == -1)
-			throw RuntimeException("Error while initializing socket", strerror(errno));
-		int flags = fcntl(socket_fd, F_GETFL, 0); 		// set nonblocking
-		if (flags == -1 || fcntl(socket_fd, F_SETFL, flags | O_NONBLOCK) == -1)
-		{
-			close(socket_fd);
-			throw RuntimeException("Error setting socket to non-blocking");
-		}
-		int optval = 1;
-		if (setsockopt(socket_fd, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval)) == -1) 	//Configure Socket
-		{
-			close(socket_fd);
-			throw RuntimeException("Error setting socket configuration");
-		}
-		struct sockaddr_in addr; 	//Bind socket to IP and Port
-		bzero(&addr, sizeof(addr));
-		addr.sin_family = AF_INET;
-		addr.sin_port = htons(port);
-		if (inet_pton(AF_INET, _ip.c_str(), &addr.sin_addr) <= 0)
-		{
-			close(socket_fd);
-			throw RuntimeException("Invalid server IP");
-		}
-		if (bind(socket_fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) //Bind Socket to port
-		{
-			close(socket_fd);
-			throw RuntimeException("Error binding the socket");
-		}
-		if (listen(socket_fd, SERVERS_BACKLOG) == -1)	// start listening
-		{
-			close(socket_fd);
-			throw RuntimeException("Error while starting the listen");
-		}
-		_sockets.push_back(socket_fd); // add to active (listening) sockets to vector
-	}
-}
-
-void	Server::shutdown()
-{
-	if (!_active)
-		return;
-	_active = false;
-	for (std::vector<int>::iterator it = _sockets.begin(); it != _sockets.end(); it++) 
-		close(*it);
-}
 RuntimeException::RuntimeException( std::string const str ) throw():
 	_message(str) {}
 RuntimeException::RuntimeException( std::string const str, std::string const error ) throw():
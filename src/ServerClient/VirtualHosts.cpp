@@ -0,0 +1,241 @@
+#include "../../include/VirtualHosts.hpp"
+#include "../../include/Utils.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <cctype>
+#include <strings.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+VirtualHosts::VirtualHosts( std::string const& ip, int port ) : _ip(ip), _port(port), _default(NULL)
+{
+}
+
+VirtualHosts::~VirtualHosts()
+{
+}
+
+// One group per address:port, in the order the servers first listen on it
+std::vector<VirtualHosts>	VirtualHosts::group( std::vector<Server> const& servers )
+{
+	std::vector<VirtualHosts> groups;
+	for (std::vector<Server>::const_iterator srv = servers.begin(); srv != servers.end(); srv++)
+	{
+		std::vector<int> const& ports = srv->get_ports();
+		for (std::vector<int>::const_iterator port = ports.begin(); port != ports.end(); port++)
+		{
+			size_t i = 0;
+			while (i < groups.size() && (groups[i]._ip != srv->get_ip() || groups[i]._port != *port))
+				i++;
+			if (i == groups.size())
+				groups.push_back(VirtualHosts(srv->get_ip(), *port));
+			groups[i].add(*srv);
+		}
+	}
+	for (size_t i = 0; i < groups.size(); i++)
+		groups[i].compile();
+	return groups;
+}
+
+std::string const&					VirtualHosts::get_ip() const { return _ip; }
+int									VirtualHosts::get_port() const { return _port; }
+std::vector<const Server*> const&	VirtualHosts::get_servers() const { return _servers; }
+Server const&						VirtualHosts::get_default() const { return *_default; }
+
+void	VirtualHosts::add( Server const& server )
+{
+	if (server.is_default_server())
+	{
+		if (_default && _default->is_default_server())
+			throw RuntimeException("Duplicate default_server for " + _ip + ":" + Utils::toString(_port));
+		_default = &server;
+	}
+	else if (!_default)
+		_default = &server;
+	_servers.push_back(&server);
+}
+
+// FNV-1a over the lowercase name
+unsigned int	VirtualHosts::hash( const char* name, size_t length )
+{
+	unsigned int value = 2166136261u;
+	for (size_t i = 0; i < length; i++)
+	{
+		value ^= static_cast<unsigned char>(std::tolower(static_cast<unsigned char>(name[i])));
+		value *= 16777619u;
+	}
+	return value;
+}
+
+// The first server to claim a name keeps it, as in nginx. Names are stored
+// lowercase whatever case they come in, which find() relies on; an empty name
+// could only match an empty Host, which selects the default server, so it is
+// not stored.
+void	VirtualHosts::insert( NameTable& table, std::string const& name, Server const& server )
+{
+	if (name.empty())
+		return;
+	std::string lower = Utils::toLower(name);
+	size_t mask = table.size() - 1;
+	unsigned int value = hash(lower.data(), lower.length());
+	for (size_t i = value & mask; ; i = (i + 1) & mask)
+	{
+		if (!table[i].server)
+		{
+			table[i].hash = value;
+			table[i].name = lower;
+			table[i].server = &server;
+			return;
+		}
+		if (table[i].hash == value && table[i].name == lower)
+			return;
+	}
+}
+
+Server const*	VirtualHosts::find( NameTable const& table, const char* name, size_t length )
+{
+	if (table.empty())
+		return NULL;
+	size_t mask = table.size() - 1;
+	unsigned int value = hash(name, length);
+	for (size_t i = value & mask; table[i].server; i = (i + 1) & mask)
+	{
+		if (table[i].hash == value && table[i].name.length() == length
+			&& strncasecmp(table[i].name.data(), name, length) == 0)
+			return table[i].server;
+	}
+	return NULL;
+}
+
+// Sorts every server_name into its table; each table is a power of two at
+// least twice its name count, so probes stay short and always end
+void	VirtualHosts::compile()
+{
+	std::vector<std::pair<std::string, const Server*> > exact, leading, trailing;
+	for (std::vector<const Server*>::const_iterator srv = _servers.begin(); srv != _servers.end(); srv++)
+	{
+		std::vector<std::string> const& names = (*srv)->get_server_names();
+		for (std::vector<std::string>::const_iterator it = names.begin(); it != names.end(); it++)
+		{
+			std::string const& name = *it;
+			if (name.empty())
+				continue;
+			if (name.compare(0, 2, "*.") == 0)
+				leading.push_back(std::make_pair(name.substr(1), *srv));
+			else if (name[0] == '.')
+			{
+				leading.push_back(std::make_pair(name, *srv));
+				exact.push_back(std::make_pair(name.substr(1), *srv));
+			}
+			else if (name.length() > 2 && name.compare(name.length() - 2, 2, ".*") == 0)
+				trailing.push_back(std::make_pair(name.substr(0, name.length() - 1), *srv));
+			else
+				exact.push_back(std::make_pair(name, *srv));
+		}
+	}
+
+	std::vector<std::pair<std::string, const Server*> >* lists[3] = { &exact, &leading, &trailing };
+	NameTable* tables[3] = { &_exact, &_leading, &_trailing };
+	for (int t = 0; t < 3; t++)
+	{
+		tables[t]->clear();
+		if (lists[t]->empty())
+			continue;
+		size_t size = 2;
+		while (size < lists[t]->size() * 2)
+			size *= 2;
+		Slot free_slot;
+		free_slot.hash = 0;
+		free_slot.server = NULL;
+		tables[t]->assign(size, free_slot);
+		for (size_t i = 0; i < lists[t]->size(); i++)
+			insert(*tables[t], (*lists[t])[i].first, *(*lists[t])[i].second);
+	}
+}
+
+// The server answering for a Host header value
+Server const&	VirtualHosts::select( std::string const& host ) const
+{
+	// Drop the port and a trailing dot; keep IPv6 literals whole
+	size_t length = host.length();
+	if (!host.empty() && host[0] == '[')
+	{
+		size_t end = host.find(']');
+		length = (end == std::string::npos ? host.length() : end + 1);
+	}
+	else
+		length = std::min(length, host.find(':'));
+	if (length > 0 && host[length - 1] == '.')
+		length--;
+	if (length == 0)
+		return *_default;
+
+	const char* name = host.data();
+	Server const* server = find(_exact, name, length);
+	if (server)
+		return *server;
+	// Longest leading wildcard: suffixes from the first dot on
+	for (size_t i = 0; i < length && !_leading.empty(); i++)
+	{
+		if (name[i] == '.' && (server = find(_leading, name + i, length - i)))
+			return *server;
+	}
+	// Longest trailing wildcard: prefixes up to the last dot first
+	for (size_t i = length; i > 0 && !_trailing.empty(); i--)
+	{
+		if (name[i - 1] == '.' && (server = find(_trailing, name, i)))
+			return *server;
+	}
+	return *_default;
+}
+
+// Opens one listening socket for a single worker. Every call binds a new
+// socket with SO_REUSEPORT, so each worker owns its own listener and the
+// kernel spreads incoming connections between them.
+int	VirtualHosts::listen()
+{
+	if (_port < 0 || _port > 65535)
+		throw RuntimeException("Invalid port");
+	int socket_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0); 	// open socket, nonblocking
+	if (socket_fd == -1)
+		throw RuntimeException("Error while initializing socket", strerror(errno));
+	int optval = 1;
+	if (setsockopt(socket_fd, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval)) == -1 	//Configure Socket
+		|| setsockopt(socket_fd, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval)) == -1)
+	{
+		close(socket_fd);
+		throw RuntimeException("Error setting socket configuration");
+	}
+	struct sockaddr_in addr; 	//Bind socket to IP and Port
+	bzero(&addr, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(_port);
+	if (inet_pton(AF_INET, _ip.c_str(), &addr.sin_addr) <= 0)
+	{
+		close(socket_fd);
+		throw RuntimeException("Invalid server IP");
+	}
+	if (bind(socket_fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) //Bind Socket to port
+	{
+		close(socket_fd);
+		throw RuntimeException("Error binding the socket");
+	}
+	if (::listen(socket_fd, SERVERS_BACKLOG) == -1)	// start listening
+	{
+		close(socket_fd);
+		throw RuntimeException("Error while starting the listen");
+	}
+	_sockets.push_back(socket_fd);
+	return socket_fd;
+}
+
+void	VirtualHosts::shutdown()
+{
+	for (std::vector<int>::iterator it = _sockets.begin(); it != _sockets.end(); it++)
+		close(*it);
+	_sockets.clear();
+}
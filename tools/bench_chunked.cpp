@@ -0,0 +1,96 @@
+// Chunked decoder throughput: decodes a 100 MB body sent as 1 KB chunks, fed
+// to Request in socket-sized reads. Two baselines frame the result: memcpy
+// into a buffer that is already faulted in, and appending the same reads to a
+// new std::string, which is what storing any body in memory costs.
+// Build and run with `make bench`.
+#include "../include/Request.hpp"
+#include <cstdio>
+#include <cstring>
+#include <sys/time.h>
+
+#define BODY_SIZE (100 * 1024 * 1024)
+#define CHUNK_SIZE 1024
+#define READ_SIZE 4096 // what handle_client_data() reads per recv()
+#define ROUNDS 3
+
+static double now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static double decode(const std::string& wire)
+{
+    Request request;
+    const char* head = "POST /bench HTTP/1.1\r\nHost: bench\r\nTransfer-Encoding: chunked\r\n\r\n";
+    request.appendData(head, strlen(head));
+    request.setMaxBodySize(BODY_SIZE);
+    request.setBodyBuffer(BODY_SIZE, "/tmp"); // keep it in memory: measure the decoder, not the disk
+    request.beginBody();
+
+    double start = now();
+    for (size_t offset = 0; offset < wire.size(); offset += READ_SIZE)
+        request.appendData(wire.data() + offset, std::min(static_cast<size_t>(READ_SIZE), wire.size() - offset));
+    double elapsed = now() - start;
+
+    if (!request.isComplete() || request.hasError() || request.getBody().size() != BODY_SIZE) {
+        fprintf(stderr, "decode failed: complete=%d error=%d body=%lu\n", request.isComplete(),
+                request.hasError(), static_cast<unsigned long>(request.getBody().size()));
+        return -1;
+    }
+    return elapsed;
+}
+
+static double copy(const std::string& wire, std::string& out)
+{
+    double start = now();
+    for (size_t offset = 0; offset < wire.size(); offset += READ_SIZE) {
+        size_t length = std::min(static_cast<size_t>(READ_SIZE), wire.size() - offset);
+        memcpy(&out[0] + offset, wire.data() + offset, length);
+    }
+    return now() - start;
+}
+
+static double append(const std::string& wire)
+{
+    double start = now();
+    std::string out;
+    for (size_t offset = 0; offset < wire.size(); offset += READ_SIZE)
+        out.append(wire.data() + offset, std::min(static_cast<size_t>(READ_SIZE), wire.size() - offset));
+    return now() - start;
+}
+
+int main()
+{
+    std::string chunk(CHUNK_SIZE, 'x');
+    std::string wire;
+    wire.reserve(BODY_SIZE + BODY_SIZE / CHUNK_SIZE * 8 + 8);
+    for (size_t sent = 0; sent < BODY_SIZE; sent += CHUNK_SIZE)
+        wire += "400\r\n" + chunk + "\r\n";
+    wire += "0\r\n\r\n";
+    std::string out(wire.size(), '\0');
+
+    double best_decode = 0, best_copy = 0, best_append = 0;
+    for (int round = 0; round < ROUNDS; ++round) {
+        double decoded = decode(wire);
+        if (decoded < 0)
+            return 1;
+        double copied = copy(wire, out);
+        double appended = append(wire);
+        if (round == 0 || decoded < best_decode)
+            best_decode = decoded;
+        if (round == 0 || copied < best_copy)
+            best_copy = copied;
+        if (round == 0 || appended < best_append)
+            best_append = appended;
+    }
+    double megabytes = BODY_SIZE / (1024.0 * 1024.0);
+    printf("chunked decode: %.0f MB in %lu-byte chunks, %.3f s, %.0f MB/s\n",
+           megabytes, static_cast<unsigned long>(CHUNK_SIZE), best_decode, megabytes / best_decode);
+    printf("memcpy:         %.0f MB, %.3f s, %.0f MB/s (decode at %.0f%% of it)\n",
+           megabytes, best_copy, megabytes / best_copy, 100.0 * best_copy / best_decode);
+    printf("string append:  %.0f MB, %.3f s, %.0f MB/s (decode at %.0f%% of it)\n",
+           megabytes, best_append, megabytes / best_append, 100.0 * best_append / best_decode);
+    return 0;
+}
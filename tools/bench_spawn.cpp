@@ -0,0 +1,115 @@
+// CGI spawn latency: starts /bin/true with its stdin, stdout and stderr on
+// pipes and waits for it to exit, from a process that has grown a 512 MB heap
+// the way a busy server does. fork() and exec, which scripts used to be
+// started with, copies the page tables of that heap for every script;
+// CGI::spawnProcess() (vfork() and exec) does not, and the zygote starts the
+// child from a process that never grew at all.
+// Build and run with `make bench`.
+#include "../include/CGI.hpp"
+#include "../include/CGIZygote.hpp"
+#include <cstdio>
+#include <cstring>
+#include <poll.h>
+#include <sys/time.h>
+
+#define HEAP_SIZE (512UL * 1024 * 1024)
+#define SPAWNS 500
+#define PROGRAM "/bin/true"
+
+static double now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+// Waits until the child closed its stdout, which it does by exiting
+static void wait_for_eof(int fd)
+{
+    char buffer[256];
+    while (read(fd, buffer, sizeof(buffer)) > 0)
+        ;
+}
+
+static pid_t spawn_fork(char** env, const int child_fds[3])
+{
+    pid_t child = fork();
+    if (child == 0) {
+        for (int i = 0; i < 3; ++i)
+            dup2(child_fds[i], i);
+        char* argv[] = { const_cast<char*>(PROGRAM), NULL };
+        execve(PROGRAM, argv, env);
+        _exit(127);
+    }
+    return child;
+}
+
+// Microseconds per spawn, started in the server (use_fork or not) or by the
+// zygote on channel
+static double measure(bool use_fork, int channel, char** env)
+{
+    double start = now();
+    for (int i = 0; i < SPAWNS; ++i) {
+        int pipe_in[2], pipe_out[2], pipe_err[2];
+        if (channel != -1) {
+            std::string message;
+            message.append(1, '\0').append(PROGRAM).append(1, '\0');
+            pid_t child;
+            int fds[4];
+            if (!CGIZygote::request(channel, message))
+                return -1;
+            // The server waits in epoll; here the answer is all there is to wait for
+            struct pollfd answered = { channel, POLLIN, 0 };
+            if (poll(&answered, 1, -1) != 1 || CGIZygote::receive(channel, child, fds) != 1 || child <= 0)
+                return -1;
+            close(fds[0]);
+            wait_for_eof(fds[1]);
+            for (int j = 1; j < 4; ++j)
+                close(fds[j]);
+            continue;
+        }
+        if (pipe2(pipe_in, O_CLOEXEC) == -1 || pipe2(pipe_out, O_CLOEXEC) == -1 || pipe2(pipe_err, O_CLOEXEC) == -1)
+            return -1;
+        int child_fds[3] = { pipe_in[0], pipe_out[1], pipe_err[1] };
+        pid_t child = use_fork ? spawn_fork(env, child_fds) : CGI::spawnProcess("", PROGRAM, env, child_fds);
+        close(pipe_in[0]);
+        close(pipe_out[1]);
+        close(pipe_err[1]);
+        if (child <= 0)
+            return -1;
+        close(pipe_in[1]);
+        wait_for_eof(pipe_out[0]);
+        waitpid(child, NULL, 0);
+        close(pipe_out[0]);
+        close(pipe_err[0]);
+    }
+    return (now() - start) * 1e6 / SPAWNS;
+}
+
+int main()
+{
+    CGIZygote zygote; // forked while the process is still small, as in main()
+    if (!zygote.start(1)) {
+        fprintf(stderr, "zygote failed to start\n");
+        return 1;
+    }
+
+    char* heap = static_cast<char*>(malloc(HEAP_SIZE));
+    if (!heap)
+        return 1;
+    memset(heap, 1, HEAP_SIZE); // fault every page in, so each one is mapped
+    char* env[] = { NULL };
+
+    double forked = measure(true, -1, env);
+    double spawned = measure(false, -1, env);
+    double zygote_spawned = measure(false, zygote.getChannel(0), env);
+    if (forked < 0 || spawned < 0 || zygote_spawned < 0) {
+        fprintf(stderr, "spawn failed\n");
+        return 1;
+    }
+    printf("fork + exec:        %6.0f us per script (%lu MB heap)\n", forked, HEAP_SIZE / (1024 * 1024));
+    printf("vfork + exec:       %6.0f us per script (%.1fx faster)\n", spawned, forked / spawned);
+    printf("zygote:             %6.0f us per script (%.1fx faster)\n", zygote_spawned, forked / zygote_spawned);
+    free(heap);
+    return 0;
+}